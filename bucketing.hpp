@@ -0,0 +1,81 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include <robin_hood.h>
+
+namespace kmer::detail
+{
+    // sorted distinct hashes and the start of each of their buckets, offsets has one more element holding the end
+    template<typename hash_t, typename position_t>
+    struct sparse_buckets
+    {
+        std::vector<hash_t> keys;
+        std::vector<position_t> offsets;
+    };
+
+    // group the positions produced by for_each by their hash with two passes over them (c.f. [1])
+    // for_each(f) calls f(hash, position) for every pair and is invoked twice, so it has to produce the same pairs
+    // the positions of keys[i] are written to [offsets[i], offsets[i + 1]) of positions in the order they are produced,
+    // the first bucket starts at first. positions is resized if it is too short, callers sharing it between threads
+    // size it beforehand
+    template<typename hash_t, typename position_t, typename map_hash_t = robin_hood::hash<hash_t>, typename for_each_t>
+    sparse_buckets<hash_t, position_t> bucket_sparse(for_each_t&& for_each, std::vector<position_t>& positions,
+                                                     size_t first = 0)
+    {
+        robin_hood::unordered_map<hash_t, position_t, map_hash_t> cursors;
+
+        // count occurrences per hash
+        for_each([&](const hash_t& h, size_t) { cursors[h]++; });
+
+        sparse_buckets<hash_t, position_t> out;
+
+        out.keys.reserve(cursors.size());
+        for (const auto& pair : cursors)
+            out.keys.push_back(pair.first);
+
+        std::sort(out.keys.begin(), out.keys.end());
+
+        // exact bucket sizes are known, turn counts into the start of each bucket
+        out.offsets.reserve(out.keys.size() + 1);
+
+        size_t sum = first;
+        for (const hash_t& key : out.keys)
+        {
+            out.offsets.push_back(sum);
+
+            auto& cursor = cursors.find(key)->second;
+            size_t n = cursor;
+            cursor = sum;
+            sum += n;
+        }
+        out.offsets.push_back(sum);
+
+        if (positions.size() < sum)
+            positions.resize(sum);
+
+        // fill using the start of each bucket as cursor
+        for_each([&](const hash_t& h, size_t i) { positions[cursors.find(h)->second++] = i; });
+
+        return out;
+    }
+}
+
+// ###################################
+//
+// [1]
+//
+// The first pass counts the occurrences of each hash, the counts of the sorted keys are then replaced by the start
+// of their bucket and the second pass writes each position to the start of its bucket while advancing it. Both
+// passes do one map operation per pair and the positions land in their final place, so no bucket is ever regrown.
+// Producing the pairs a second time is cheaper than storing them, as they come from a rolling hash over the text
+// (or a window minimum over it for the minimizer index). Positions are produced in ascending order, so every bucket
+// is sorted without sorting it. kmer_index_element calls this once per shard of the hash space, with first set to
+// the start of the shard in the shared positions (c.f. [7] in kmer_index.hpp).
+//
+// ###################################
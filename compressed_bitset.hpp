@@ -2,9 +2,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
 namespace kmer::detail
 {
     // runtime-optimized functional equivalent for std::vector<bool>
+    // all word operations are portable loops over std::popcount and the bitwise operators, there are intentionally
+    // no AVX2 or AVX-512 paths: popcnt and any vectorization of the loops are left to the compiler and its -m flags
     template<typename integer_t = uint_fast64_t>
     class compressed_bitset
     {
@@ -14,9 +23,29 @@ namespace kmer::detail
             static constexpr integer_t _rshift_v = log2((sizeof(integer_t) * 8));  // i / n = i >> log2(n)
             static constexpr integer_t _one = 1, _zero = 0, _not_zero = ~_zero;
 
+            static constexpr size_t _bits_per_word = sizeof(integer_t) * 8;
+
             size_t _n_bits;
             std::vector<integer_t> _bits;
 
+            // bits of word_i that lie inside the bitset, the bits past _n_bits in the last word are undefined
+            integer_t valid_bits(size_t word_i) const
+            {
+                size_t first = word_i << _rshift_v;
+                if (first + _bits_per_word <= _n_bits)
+                    return _not_zero;
+                else if (first >= _n_bits)
+                    return _zero;
+                else
+                    return (_one << (_n_bits - first)) - _one;
+            }
+
+            void check_same_size(const compressed_bitset& other) const
+            {
+                if (other._n_bits != _n_bits)
+                    throw std::invalid_argument("compressed bitsets have to be of the same size");
+            }
+
         public:
             // CTOR
             compressed_bitset(size_t n_bits, bool zero_or_one)
@@ -25,6 +54,13 @@ namespace kmer::detail
                 _n_bits = n_bits;
             }
 
+            // resize to n_bits bits that are all zero_or_one, keeps the memory if it is large enough
+            void assign(size_t n_bits, bool zero_or_one)
+            {
+                _bits.assign(std::max(n_bits / (sizeof(integer_t) * 8) + 1, 1ul), (zero_or_one ? _not_zero : _zero));
+                _n_bits = n_bits;
+            }
+
             [[nodiscard]]
             std::vector<bool> to_vector() const
             {
@@ -71,6 +107,138 @@ namespace kmer::detail
                 return v;
             }
 
+            // index of the first 1 at or after i, size() if there is none
+            // whole words of 0 are skipped, so the cost is proportional to the number of words between the 1s
+            size_t next_1(size_t i) const
+            {
+                if (i >= _n_bits)
+                    return _n_bits;
+
+                size_t word_i = i >> _rshift_v;
+                integer_t word = _bits[word_i] & (_not_zero << (i & _and_v));
+
+                while (word == _zero)
+                {
+                    if (++word_i == _bits.size())
+                        return _n_bits;
+
+                    word = _bits[word_i];
+                }
+
+                // bits of the last word past _n_bits may be 1
+                return std::min<size_t>((word_i << _rshift_v) + std::countr_zero(word), _n_bits);
+            }
+
+            // index of the last 1 at or before i, size() if there is none
+            size_t previous_1(size_t i) const
+            {
+                if (_n_bits == 0)
+                    return _n_bits;
+
+                i = std::min<size_t>(i, _n_bits - 1);
+
+                size_t word_i = i >> _rshift_v;
+                integer_t word = _bits[word_i] & (_not_zero >> (_and_v - (i & _and_v)));
+
+                while (word == _zero)
+                {
+                    if (word_i == 0)
+                        return _n_bits;
+
+                    word = _bits[--word_i];
+                }
+
+                return (word_i << _rshift_v) + _and_v - std::countl_zero(word);
+            }
+
+            // set bits [first, last) to zero_or_one
+            void set_range(size_t first, size_t last, bool zero_or_one)
+            {
+                if (first > last or last > _n_bits)
+                    throw std::out_of_range("compressed bitset range out of range");
+
+                for (size_t word_i = first >> _rshift_v; first < last; ++word_i)
+                {
+                    size_t word_end = std::min(((word_i + 1) << _rshift_v), last);
+                    size_t n = word_end - first;
+
+                    integer_t mask = (n == _bits_per_word ? _not_zero : ((_one << n) - _one)) << (first & _and_v);
+                    if (zero_or_one)
+                        _bits[word_i] |= mask;
+                    else
+                        _bits[word_i] &= ~mask;
+
+                    first = word_end;
+                }
+            }
+
+            // bitwise and, or and and-not with a bitset of the same size, one operation per word
+            compressed_bitset& operator&=(const compressed_bitset& other)
+            {
+                check_same_size(other);
+                for (size_t i = 0; i < _bits.size(); ++i)
+                    _bits[i] &= other._bits[i];
+
+                return *this;
+            }
+
+            compressed_bitset& operator|=(const compressed_bitset& other)
+            {
+                check_same_size(other);
+                for (size_t i = 0; i < _bits.size(); ++i)
+                    _bits[i] |= other._bits[i];
+
+                return *this;
+            }
+
+            // clear all bits that are 1 in other
+            compressed_bitset& and_not(const compressed_bitset& other)
+            {
+                check_same_size(other);
+                for (size_t i = 0; i < _bits.size(); ++i)
+                    _bits[i] &= ~other._bits[i];
+
+                return *this;
+            }
+
+            // number of 1s in [0, i)
+            size_t rank_1(size_t i) const
+            {
+                i = std::min(i, _n_bits);
+
+                size_t n = 0;
+                for (size_t word_i = 0; word_i < (i >> _rshift_v); ++word_i)
+                    n += std::popcount(_bits[word_i]);
+
+                if ((i & _and_v) != 0)
+                    n += std::popcount(_bits[i >> _rshift_v] & ((_one << (i & _and_v)) - _one));
+
+                return n;
+            }
+
+            // index of the nth 1 (counting from 0), size() if there are at most n 1s
+            size_t select_1(size_t n) const
+            {
+                for (size_t word_i = 0; word_i < _bits.size(); ++word_i)
+                {
+                    integer_t word = _bits[word_i] & valid_bits(word_i);
+                    size_t n_ones = std::popcount(word);
+
+                    if (n < n_ones)
+                    {
+                        // drop the lowest n 1s of the word
+                        for (; n > 0; --n)
+                            word &= word - _one;
+
+                        return (word_i << _rshift_v) + std::countr_zero(word);
+                    }
+
+                    n -= n_ones;
+                }
+
+                return _n_bits;
+            }
+
             // reset all bits to 1
             void clear_to_1()
             {
@@ -90,15 +258,17 @@ namespace kmer::detail
                 return _n_bits;
             }
 
-            // popcount
+            // popcount, one std::popcount per word
             size_t count_bits_equal_to(bool b) const
             {
-                // TODO: use new x86 std::popcount instead
                 size_t n_ones = 0;
 
-                for (size_t i = 0; i < _n_bits; ++i)
-                    if (at(i))
-                        n_ones++;
+                size_t n_full_words = _n_bits >> _rshift_v;
+                for (size_t i = 0; i < n_full_words; ++i)
+                    n_ones += std::popcount(_bits[i]);
+
+                if (n_full_words < _bits.size())
+                    n_ones += std::popcount(_bits[n_full_words] & valid_bits(n_full_words));
 
                 return (b ? n_ones : _n_bits - n_ones);
             }
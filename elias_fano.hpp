@@ -0,0 +1,422 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <serialization.hpp>
+
+namespace kmer::detail
+{
+    // compressed monotone sequence of integers with successor queries (c.f. [1])
+    class elias_fano
+    {
+        private:
+            // every _sample_rate-th one and zero in _high_bits have their position stored
+            constexpr static size_t _sample_rate = 256;
+
+            size_t _size = 0;
+            size_t _capacity = 0;
+            size_t _low_width = 0;
+            uint64_t _low_mask = 0;
+            uint64_t _last = 0;
+
+            flat_array<uint64_t> _low_bits;
+            flat_array<uint64_t> _high_bits;
+            flat_array<uint64_t> _one_samples;
+            flat_array<uint64_t> _zero_samples;
+
+            uint64_t get_low(size_t i) const
+            {
+                if (_low_width == 0)
+                    return 0;
+
+                size_t bit = i * _low_width;
+                size_t word = bit >> 6, shift = bit & 63;
+
+                uint64_t out = _low_bits[word] >> shift;
+                if (shift + _low_width > 64)
+                    out |= _low_bits[word + 1] << (64 - shift);
+
+                return out & _low_mask;
+            }
+
+            void set_low(size_t i, uint64_t v)
+            {
+                if (_low_width == 0)
+                    return;
+
+                size_t bit = i * _low_width;
+                size_t word = bit >> 6, shift = bit & 63;
+
+                _low_bits[word] |= v << shift;
+                if (shift + _low_width > 64)
+                    _low_bits[word + 1] |= v >> (64 - shift);
+            }
+
+            // position of the r-th set bit in word
+            static size_t select_in_word(uint64_t word, size_t r)
+            {
+                for (size_t i = 0; i < r; ++i)
+                    word &= word - 1;
+
+                return std::countr_zero(word);
+            }
+
+            // position of the n-th one in _high_bits
+            size_t select_one(size_t n) const
+            {
+                size_t pos = _one_samples[n / _sample_rate];
+                size_t rest = n % _sample_rate;
+
+                size_t word_i = pos >> 6;
+                uint64_t word = _high_bits[word_i] & (~uint64_t(0) << (pos & 63));
+
+                while (true)
+                {
+                    size_t n_ones = std::popcount(word);
+                    if (rest < n_ones)
+                        return (word_i << 6) + select_in_word(word, rest);
+
+                    rest -= n_ones;
+                    word = _high_bits[++word_i];
+                }
+            }
+
+            // position of the n-th zero in _high_bits
+            size_t select_zero(size_t n) const
+            {
+                size_t pos = _zero_samples[n / _sample_rate];
+                size_t rest = n % _sample_rate;
+
+                size_t word_i = pos >> 6;
+                uint64_t word = ~_high_bits[word_i] & (~uint64_t(0) << (pos & 63));
+
+                while (true)
+                {
+                    size_t n_zeros = std::popcount(word);
+                    if (rest < n_zeros)
+                        return (word_i << 6) + select_in_word(word, rest);
+
+                    rest -= n_zeros;
+                    word = ~_high_bits[++word_i];
+                }
+            }
+
+            // position of the first one at or after pos
+            size_t next_one(size_t pos) const
+            {
+                size_t word_i = pos >> 6;
+                uint64_t word = _high_bits[word_i] & (~uint64_t(0) << (pos & 63));
+
+                while (word == 0)
+                    word = _high_bits[++word_i];
+
+                return (word_i << 6) + std::countr_zero(word);
+            }
+
+        public:
+            // forward iterator with successor search
+            class cursor
+            {
+                friend class elias_fano;
+
+                private:
+                    const elias_fano* _sequence = nullptr;
+                    size_t _i = 0;
+                    size_t _pos = 0; // position of the one belonging to _i in _high_bits
+
+                    cursor(const elias_fano* sequence, size_t i)
+                        : _sequence(sequence), _i(i), _pos(i < sequence->_size ? sequence->select_one(i) : 0)
+                    {}
+
+                public:
+                    cursor() = default;
+
+                    size_t index() const
+                    {
+                        return _i;
+                    }
+
+                    uint64_t value() const
+                    {
+                        return ((_pos - _i) << _sequence->_low_width) | _sequence->get_low(_i);
+                    }
+
+                    void next()
+                    {
+                        if (++_i < _sequence->_size)
+                            _pos = _sequence->next_one(_pos + 1);
+                    }
+
+                    // advance to the first element >= x, never moves backwards
+                    void next_geq(uint64_t x)
+                    {
+                        if (_i >= _sequence->_size)
+                            return;
+
+                        // no element is >= x, select_zero would run past the last bucket
+                        if (x > _sequence->_last)
+                        {
+                            _i = _sequence->_size;
+                            return;
+                        }
+
+                        size_t high = x >> _sequence->_low_width;
+
+                        // jump to the first element whose high part is >= high
+                        if (high > _pos - _i)
+                        {
+                            size_t bucket_begin = _sequence->select_zero(high - 1) + 1;
+                            _i = bucket_begin - high;
+
+                            if (_i >= _sequence->_size)
+                                return;
+
+                            _pos = _sequence->next_one(bucket_begin);
+                        }
+
+                        while (_i < _sequence->_size and value() < x)
+                            next();
+                    }
+            };
+
+            // CTOR
+            elias_fano() = default;
+
+            // allocate for exactly size elements, all of which have to be < universe
+            elias_fano(size_t size, uint64_t universe)
+                : _capacity(size)
+            {
+                _low_width = (size > 0 and universe / size > 0) ? std::bit_width(universe / size) - 1 : 0;
+                _low_mask = _low_width == 0 ? 0 : (~uint64_t(0) >> (64 - _low_width));
+
+                // trailing words so reads past the last element stay in bounds
+                _low_bits = flat_array<uint64_t>(std::vector<uint64_t>((size * _low_width) / 64 + 2, 0));
+                _high_bits = flat_array<uint64_t>(std::vector<uint64_t>((size + (universe >> _low_width) + 1) / 64 + 3, 0));
+            }
+
+            // append element, elements have to be pushed in non-decreasing order
+            void push_back(uint64_t v)
+            {
+                assert(_size < _capacity and v >= _last);
+
+                set_low(_size, v & _low_mask);
+
+                size_t pos = (v >> _low_width) + _size;
+                _high_bits[pos >> 6] |= uint64_t(1) << (pos & 63);
+
+                _last = v;
+                ++_size;
+            }
+
+            // compute select samples, has to be called after the last push_back
+            void finalize()
+            {
+                std::vector<uint64_t> one_samples, zero_samples;
+
+                size_t n_ones = 0, n_zeros = 0;
+                for (size_t word_i = 0; word_i + 1 < _high_bits.size(); ++word_i)
+                {
+                    for (size_t bit = 0; bit < 64; ++bit)
+                    {
+                        if ((_high_bits[word_i] >> bit) & 1)
+                        {
+                            if (n_ones++ % _sample_rate == 0)
+                                one_samples.push_back((word_i << 6) + bit);
+                        }
+                        else
+                        {
+                            if (n_zeros++ % _sample_rate == 0)
+                                zero_samples.push_back((word_i << 6) + bit);
+                        }
+                    }
+                }
+
+                _one_samples = flat_array<uint64_t>(std::move(one_samples));
+                _zero_samples = flat_array<uint64_t>(std::move(zero_samples));
+
+                // guarantee at least one set bit after the last element so scans terminate
+                _high_bits[_high_bits.size() - 1] = ~uint64_t(0);
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+
+            // ith element
+            uint64_t at(size_t i) const
+            {
+                if (i >= _size)
+                    throw std::out_of_range("elias fano index out of range");
+
+                return cursor(this, i).value();
+            }
+
+            // cursor pointing to ith element
+            cursor cursor_at(size_t i) const
+            {
+                return cursor(this, i);
+            }
+
+            // memory used in bytes
+            size_t n_bytes() const
+            {
+                return (_low_bits.size() + _high_bits.size() + _one_samples.size() + _zero_samples.size()) * sizeof(uint64_t);
+            }
+
+            void save(binary_writer& out) const
+            {
+                out.write_value<uint64_t>(_size);
+                out.write_value<uint64_t>(_low_width);
+                out.write_array(_low_bits.view());
+                out.write_array(_high_bits.view());
+                out.write_array(_one_samples.view());
+                out.write_array(_zero_samples.view());
+            }
+
+            // arrays stay views into the mapped file
+            void load(binary_reader& in)
+            {
+                _size = _capacity = in.read_value<uint64_t>();
+                _low_width = in.read_value<uint64_t>();
+                _low_mask = _low_width == 0 ? 0 : (~uint64_t(0) >> (64 - _low_width));
+                _low_bits = flat_array<uint64_t>(in.read_array<uint64_t>());
+                _high_bits = flat_array<uint64_t>(in.read_array<uint64_t>());
+                _one_samples = flat_array<uint64_t>(in.read_array<uint64_t>());
+                _zero_samples = flat_array<uint64_t>(in.read_array<uint64_t>());
+                _last = _size > 0 ? cursor(this, _size - 1).value() : 0;
+            }
+    };
+
+    // view of the positions of one kmer, either plain or as part of an elias fano sequence
+    template<typename position_t>
+    class position_list
+    {
+        private:
+            std::span<const position_t> _plain;
+
+            // elements [_begin, _end) of _encoded, stored as _base + position
+            const elias_fano* _encoded = nullptr;
+            size_t _begin = 0, _end = 0;
+            uint64_t _base = 0;
+
+        public:
+            // successor search over the list, targets have to be non-decreasing
+            class cursor
+            {
+                private:
+                    const position_list* _list;
+                    size_t _plain_i = 0;
+                    elias_fano::cursor _encoded_it;
+
+                public:
+                    cursor(const position_list* list)
+                        : _list(list),
+                          _encoded_it(list->_encoded != nullptr ? list->_encoded->cursor_at(list->_begin)
+                                                                : elias_fano::cursor())
+                    {}
+
+                    // does the list contain target
+                    bool contains(size_t target)
+                    {
+                        if (_list->_encoded == nullptr)
+                        {
+                            auto it = std::lower_bound(_list->_plain.begin() + _plain_i, _list->_plain.end(), target);
+                            _plain_i = it - _list->_plain.begin();
+                            return it != _list->_plain.end() and *it == target;
+                        }
+
+                        _encoded_it.next_geq(_list->_base + target);
+                        return _encoded_it.index() < _list->_end and _encoded_it.value() == _list->_base + target;
+                    }
+            };
+
+            // CTORs
+            position_list() = default;
+
+            position_list(std::span<const position_t> plain)
+                : _plain(plain)
+            {}
+
+            position_list(const elias_fano* encoded, size_t begin, size_t end, uint64_t base)
+                : _encoded(encoded), _begin(begin), _end(end), _base(base)
+            {}
+
+            size_t size() const
+            {
+                return _encoded == nullptr ? _plain.size() : _end - _begin;
+            }
+
+            bool empty() const
+            {
+                return size() == 0;
+            }
+
+            bool is_encoded() const
+            {
+                return _encoded != nullptr;
+            }
+
+            // plain positions, only valid if not encoded
+            std::span<const position_t> plain() const
+            {
+                assert(not is_encoded());
+                return _plain;
+            }
+
+            // plain positions, decoded into buffer if encoded
+            std::span<const position_t> plain_or_decode(std::vector<position_t>& buffer) const
+            {
+                if (not is_encoded())
+                    return _plain;
+
+                decode(buffer);
+                return std::span<const position_t>(buffer);
+            }
+
+            // append all positions to out
+            void decode(std::vector<position_t>& out) const
+            {
+                if (_encoded == nullptr)
+                {
+                    out.insert(out.end(), _plain.begin(), _plain.end());
+                    return;
+                }
+
+                auto it = _encoded->cursor_at(_begin);
+                for (size_t i = _begin; i < _end; ++i, it.next())
+                    out.push_back(it.value() - _base);
+            }
+
+            cursor get_cursor() const
+            {
+                return cursor(this);
+            }
+    };
+} // end of namespace kmer::detail
+
+// ###################################
+//
+// [1]
+//
+// Elias-Fano encodes a non-decreasing sequence of n integers < u by splitting each integer into its lowest
+// l = floor(log2(u / n)) bits, which are stored verbatim, and the remaining high bits, which are stored as
+// unary coded gaps in a bitvector of n + u / 2^l bits. This needs at most 2 + log2(u / n) bits per element.
+// Random access and successor queries use samples of every 256th one and zero in the high bitvector, after
+// which only a short forward scan using popcount is needed.
+//
+// To encode all position lists of a kmer_index_element in one sequence, the positions of bucket b are stored as
+// b * text_size + position, which makes the concatenation of all lists (sorted by bucket) monotone. A bucket is
+// the hash with direct addressing and the index of the key otherwise. The number of low bits is then about
+// log2(text_size / average list length), so the encoding pays off if the lists are long, which is the case for
+// small k.
+//
+// ###################################
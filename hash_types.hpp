@@ -0,0 +1,166 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace kmer::detail
+{
+    using uint128_t = unsigned __int128;
+
+    // 256-bit unsigned integer providing the arithmetic needed to hash kmers, overflow wraps around
+    struct uint256_t
+    {
+        uint128_t high = 0;
+        uint128_t low = 0;
+
+        // CTORs
+        constexpr uint256_t() = default;
+
+        constexpr uint256_t(uint64_t value)
+            : high(0), low(value)
+        {}
+
+        constexpr uint256_t(uint128_t high_bits, uint128_t low_bits)
+            : high(high_bits), low(low_bits)
+        {}
+
+        constexpr explicit operator uint64_t() const
+        {
+            return static_cast<uint64_t>(low);
+        }
+
+        friend constexpr uint256_t operator+(uint256_t a, uint256_t b)
+        {
+            uint128_t low = a.low + b.low;
+            return uint256_t(a.high + b.high + (low < a.low), low);
+        }
+
+        friend constexpr uint256_t operator-(uint256_t a, uint256_t b)
+        {
+            return uint256_t(a.high - b.high - (a.low < b.low), a.low - b.low);
+        }
+
+        friend constexpr uint256_t operator*(uint256_t a, uint256_t b)
+        {
+            // full 128x128 product of the low halves, cross terms only contribute to the high half
+            constexpr uint128_t mask = ~uint64_t(0);
+
+            uint128_t a_0 = a.low & mask, a_1 = a.low >> 64;
+            uint128_t b_0 = b.low & mask, b_1 = b.low >> 64;
+
+            uint128_t p_00 = a_0 * b_0, p_01 = a_0 * b_1, p_10 = a_1 * b_0, p_11 = a_1 * b_1;
+
+            uint128_t middle = (p_00 >> 64) + (p_01 & mask) + (p_10 & mask);
+            uint128_t low = (p_00 & mask) | (middle << 64);
+            uint128_t high = p_11 + (p_01 >> 64) + (p_10 >> 64) + (middle >> 64);
+
+            return uint256_t(high + a.high * b.low + a.low * b.high, low);
+        }
+
+        friend constexpr uint256_t operator>>(uint256_t a, size_t n)
+        {
+            if (n == 0)
+                return a;
+            else if (n >= 256)
+                return uint256_t();
+            else if (n >= 128)
+                return uint256_t(0, a.high >> (n - 128));
+            else
+                return uint256_t(a.high >> n, (a.low >> n) | (a.high << (128 - n)));
+        }
+
+        friend constexpr uint256_t operator<<(uint256_t a, size_t n)
+        {
+            if (n == 0)
+                return a;
+            else if (n >= 256)
+                return uint256_t();
+            else if (n >= 128)
+                return uint256_t(a.low << (n - 128), 0);
+            else
+                return uint256_t((a.high << n) | (a.low >> (128 - n)), a.low << n);
+        }
+
+        constexpr uint256_t& operator+=(uint256_t other)
+        {
+            return *this = *this + other;
+        }
+
+        constexpr uint256_t& operator++()
+        {
+            return *this = *this + uint256_t(1);
+        }
+
+        friend constexpr bool operator==(uint256_t a, uint256_t b)
+        {
+            return a.high == b.high and a.low == b.low;
+        }
+
+        friend constexpr std::strong_ordering operator<=>(uint256_t a, uint256_t b)
+        {
+            if (a.high != b.high)
+                return a.high < b.high ? std::strong_ordering::less : std::strong_ordering::greater;
+
+            if (a.low != b.low)
+                return a.low < b.low ? std::strong_ordering::less : std::strong_ordering::greater;
+
+            return std::strong_ordering::equal;
+        }
+    };
+
+    // smallest unsigned integer that can represent the hashes of all kmers of size k over alphabet of size sigma
+    template<size_t sigma, size_t k>
+    using minimal_hash_t = std::conditional_t<(k < 64 / log2(sigma)), uint64_t,
+                           std::conditional_t<(k < 128 / log2(sigma)), uint128_t,
+                                              uint256_t>>;
+
+    // sigma^0, ..., sigma^(n-1) in hash_t
+    template<typename hash_t, size_t sigma, size_t n>
+    constexpr std::array<hash_t, n> power_table()
+    {
+        std::array<hash_t, n> out{};
+        hash_t current = 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = current;
+            current = current * hash_t(sigma);
+        }
+        return out;
+    }
+
+    // number of bits needed to represent value
+    template<typename hash_t>
+    constexpr size_t bit_width(hash_t value)
+    {
+        size_t n = 0;
+        while (value != hash_t(0))
+        {
+            value = value >> 1;
+            ++n;
+        }
+        return n;
+    }
+
+    // for use in hash maps with keys wider than 64 bit
+    template<typename hash_t>
+    struct wide_hash
+    {
+        size_t operator()(const hash_t& value) const
+        {
+            // fold all 64-bit words, then finalize like splitmix64
+            uint64_t out = 0;
+            for (size_t shift = 0; shift < sizeof(hash_t) * 8; shift += 64)
+                out = (out ^ uint64_t(value >> shift)) * 0x9e3779b97f4a7c15;
+
+            out = (out ^ (out >> 30)) * 0xbf58476d1ce4e5b9;
+            out = (out ^ (out >> 27)) * 0x94d049bb133111eb;
+            return out ^ (out >> 31);
+        }
+    };
+} // end of namespace kmer::detail
@@ -0,0 +1,362 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include <compressed_bitset.hpp>
+#include <elias_fano.hpp>
+
+namespace kmer::detail
+{
+    // lists more than this many times longer than the candidates are galloped instead of merged (c.f. [1])
+    constexpr size_t _gallop_ratio = 32;
+
+    // number of list elements compared against a candidate at once while merging
+    constexpr size_t _merge_block_size = 8;
+
+    // sorted runs shorter than this on average are sorted together instead of merged (c.f. [2])
+    constexpr size_t _min_merge_run_size = 256;
+
+    // memory used by intersect, reused across calls so that repeated intersections do not allocate
+    template<typename position_t>
+    struct intersection_buffers
+    {
+        std::vector<size_t> order;
+        std::vector<position_t> decoded;
+        compressed_bitset<uint64_t> keep = compressed_bitset<uint64_t>(0, false);
+    };
+
+    // index of the first element >= target in [first, list.size()), scanning in blocks
+    template<typename position_t>
+    size_t merge_geq(std::span<const position_t> list, size_t first, uint64_t target)
+    {
+        while (first + _merge_block_size <= list.size())
+        {
+            // branchless count of the elements of the block below target, plain scalar code (c.f. [1])
+            size_t n_less = 0;
+            for (size_t i = 0; i < _merge_block_size; ++i)
+                n_less += list[first + i] < target;
+
+            first += n_less;
+            if (n_less < _merge_block_size)
+                return first;
+        }
+
+        while (first < list.size() and list[first] < target)
+            ++first;
+
+        return first;
+    }
+
+    // index of the first element >= target in [first, list.size()), exponential then binary search
+    template<typename position_t>
+    size_t gallop_geq(std::span<const position_t> list, size_t first, uint64_t target)
+    {
+        // all elements before first are < target
+        size_t last = first;
+        size_t step = 1;
+        while (last < list.size() and list[last] < target)
+        {
+            first = last + 1;
+            last += step;
+            step *= 2;
+        }
+
+        auto end = list.begin() + std::min(last, list.size());
+        return std::lower_bound(list.begin() + first, end, target) - list.begin();
+    }
+
+    // call f(i) for every i such that b contains a[i] + shift, in ascending order of i,
+    // iterates over the shorter of both sequences and searches the longer one
+    template<typename position_t, typename function_t>
+    void for_each_common(std::span<const position_t> a, std::span<const position_t> b, size_t shift, function_t&& f)
+    {
+        if (a.size() <= b.size())
+        {
+            bool gallop = b.size() > _gallop_ratio * a.size();
+
+            size_t b_i = 0;
+            for (size_t a_i = 0; a_i < a.size() and b_i < b.size(); ++a_i)
+            {
+                uint64_t target = uint64_t(a[a_i]) + shift;
+                b_i = gallop ? gallop_geq(b, b_i, target) : merge_geq(b, b_i, target);
+
+                if (b_i < b.size() and b[b_i] == target)
+                    f(a_i);
+            }
+        }
+        else
+        {
+            bool gallop = a.size() > _gallop_ratio * b.size();
+
+            size_t a_i = 0;
+            for (size_t b_i = 0; b_i < b.size() and a_i < a.size(); ++b_i)
+            {
+                if (b[b_i] < shift)
+                    continue;
+
+                uint64_t target = b[b_i] - shift;
+                a_i = gallop ? gallop_geq(a, a_i, target) : merge_geq(a, a_i, target);
+
+                if (a_i < a.size() and a[a_i] == target)
+                    f(a_i);
+            }
+        }
+    }
+
+    // call f(i) for every i such that list contains candidates[i] + shift, in ascending order of i
+    template<typename position_t, typename function_t>
+    void for_each_common(std::span<const position_t> candidates, const position_list<position_t>& list, size_t shift, function_t&& f)
+    {
+        if (not list.is_encoded())
+        {
+            for_each_common(candidates, list.plain(), shift, f);
+            return;
+        }
+
+        auto cursor = list.get_cursor();
+        for (size_t i = 0; i < candidates.size(); ++i)
+            if (cursor.contains(candidates[i] + shift))
+                f(i);
+    }
+
+    // keep only the candidates c for which list contains c + shift, candidates are ascending
+    template<typename position_t>
+    void filter_candidates(std::vector<position_t>& candidates, const position_list<position_t>& list, size_t shift)
+    {
+        // kept candidates are reported in order and never after the slot they are moved to
+        size_t n_kept = 0;
+        for_each_common(std::span<const position_t>(candidates), list, shift,
+                        [&](size_t i) { candidates[n_kept++] = candidates[i]; });
+
+        candidates.resize(n_kept);
+    }
+
+    // set bit i of keep for every candidate c = candidates[i] for which any of lists contains c + shift
+    template<typename position_t>
+    void mark_candidates_any(std::span<const position_t> candidates, const std::vector<position_list<position_t>>& lists,
+                             size_t shift, compressed_bitset<uint64_t>& keep)
+    {
+        keep.assign(candidates.size(), false);
+        for (const auto& list : lists)
+            for_each_common(candidates, list, shift, [&](size_t i) { keep.set_1(i); });
+    }
+
+    // keep only the candidates c for which any of lists contains c + shift, candidates are ascending
+    template<typename position_t>
+    void filter_candidates_any(std::vector<position_t>& candidates, const std::vector<position_list<position_t>>& lists, size_t shift,
+                               compressed_bitset<uint64_t>& keep)
+    {
+        mark_candidates_any(std::span<const position_t>(candidates), lists, shift, keep);
+
+        // runs of dropped candidates are skipped a word at a time
+        size_t n_kept = 0;
+        for (size_t i = keep.next_1(0); i < candidates.size(); i = keep.next_1(i + 1))
+            candidates[n_kept++] = candidates[i];
+
+        candidates.resize(n_kept);
+    }
+
+    // overload with its own bitset
+    template<typename position_t>
+    void filter_candidates_any(std::vector<position_t>& candidates, const std::vector<position_list<position_t>>& lists, size_t shift)
+    {
+        compressed_bitset<uint64_t> keep(0, false);
+        filter_candidates_any(candidates, lists, shift, keep);
+    }
+
+    // number of candidates c for which any of lists contains c + shift, without removing the others
+    template<typename position_t>
+    size_t count_candidates_any(std::span<const position_t> candidates, const std::vector<position_list<position_t>>& lists,
+                                size_t shift, compressed_bitset<uint64_t>& keep)
+    {
+        mark_candidates_any(candidates, lists, shift, keep);
+        return keep.count_bits_equal_to(true);
+    }
+
+    // write all positions p such that lists[i] contains p + shifts[i] for every i except the largest list to
+    // candidates, ascending, returns the index of the largest list, which is the one an intersection checks last
+    template<typename position_t>
+    size_t intersect_all_but_last(const std::vector<position_list<position_t>>& lists, const std::vector<size_t>& shifts,
+                                  std::vector<position_t>& candidates, intersection_buffers<position_t>& buffers)
+    {
+        assert(not lists.empty() and lists.size() == shifts.size());
+
+        // smallest list first, every further list can only remove candidates
+        auto& order = buffers.order;
+        order.resize(lists.size());
+        std::iota(order.begin(), order.end(), 0);
+        // ties are broken by index instead of with std::stable_sort, which allocates a temporary buffer
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return lists[a].size() < lists[b].size() or (lists[a].size() == lists[b].size() and a < b);
+        });
+
+        buffers.decoded.clear();
+        auto smallest = lists[order.front()].plain_or_decode(buffers.decoded);
+        size_t smallest_shift = shifts[order.front()];
+
+        candidates.clear();
+        candidates.reserve(smallest.size());
+        for (position_t pos : smallest)
+            if (pos >= smallest_shift)
+                candidates.push_back(pos - smallest_shift);
+
+        for (size_t i = 1; i + 1 < order.size() and not candidates.empty(); ++i)
+            filter_candidates(candidates, lists[order[i]], shifts[order[i]]);
+
+        return order.back();
+    }
+
+    // write all positions p such that lists[i] contains p + shifts[i] for every i to candidates, ascending
+    template<typename position_t>
+    void intersect(const std::vector<position_list<position_t>>& lists, const std::vector<size_t>& shifts,
+                   std::vector<position_t>& candidates, intersection_buffers<position_t>& buffers)
+    {
+        size_t last = intersect_all_but_last(lists, shifts, candidates, buffers);
+
+        if (lists.size() > 1 and not candidates.empty())
+            filter_candidates(candidates, lists[last], shifts[last]);
+    }
+
+    // number of positions p such that lists[i] contains p + shifts[i] for every i, the last list is only counted
+    // against, candidates is used as memory
+    template<typename position_t>
+    size_t count_common(const std::vector<position_list<position_t>>& lists, const std::vector<size_t>& shifts,
+                        std::vector<position_t>& candidates, intersection_buffers<position_t>& buffers)
+    {
+        if (lists.size() == 1 and shifts.front() == 0)
+            return lists.front().size();
+
+        size_t last = intersect_all_but_last(lists, shifts, candidates, buffers);
+
+        if (lists.size() == 1 or candidates.empty())
+            return candidates.size();
+
+        size_t n = 0;
+        for_each_common(std::span<const position_t>(candidates), lists[last], shifts[last], [&](size_t) { ++n; });
+        return n;
+    }
+
+    // overload that allocates its own memory
+    template<typename position_t>
+    std::vector<position_t> intersect(const std::vector<position_list<position_t>>& lists, const std::vector<size_t>& shifts)
+    {
+        std::vector<position_t> candidates;
+        intersection_buffers<position_t> buffers;
+        intersect(lists, shifts, candidates, buffers);
+        return candidates;
+    }
+
+    // write all positions of the ascending runs to output in ascending order, scratch and bounds are only
+    // used as memory (c.f. [2])
+    template<typename position_t>
+    void merge_runs(const std::vector<std::span<const position_t>>& runs, std::vector<position_t>& output,
+                    std::vector<position_t>& scratch, std::vector<size_t>& bounds)
+    {
+        size_t n = 0;
+        for (auto run : runs)
+            n += run.size();
+
+        output.clear();
+
+        // a single run is sorted already, many short runs are cheaper to sort than to merge
+        if (runs.size() <= 1 or (runs.size() > 2 and runs.size() * _min_merge_run_size > n))
+        {
+            output.reserve(n);
+            for (auto run : runs)
+                output.insert(output.end(), run.begin(), run.end());
+
+            if (runs.size() > 1)
+                std::sort(output.begin(), output.end());
+
+            return;
+        }
+
+        size_t n_runs = (runs.size() + 1) / 2;
+        size_t n_passes = std::bit_width(n_runs - 1);
+
+        output.resize(n);
+        if (n_passes > 0)
+            scratch.resize(n);
+
+        // passes alternate between output and scratch, start so that the last one ends in output
+        position_t* source = scratch.data();
+        position_t* target = output.data();
+
+        if (n_passes % 2 == 1)
+            std::swap(source, target);
+
+        // the first pass merges pairs of runs, run i is [bounds[i], bounds[i+1]) afterwards
+        bounds.assign(1, 0);
+        size_t offset = 0;
+        for (size_t i = 0; i < runs.size(); i += 2)
+        {
+            auto first = runs[i];
+            auto second = i + 1 < runs.size() ? runs[i + 1] : std::span<const position_t>();
+
+            std::merge(first.begin(), first.end(), second.begin(), second.end(), target + offset);
+            offset += first.size() + second.size();
+            bounds.push_back(offset);
+        }
+
+        for (size_t pass = 0; pass < n_passes; ++pass)
+        {
+            std::swap(source, target);
+
+            // bounds are compacted in place, the written index always trails the read ones
+            size_t n_merged = 0;
+            for (size_t i = 0; i + 1 < bounds.size(); i += 2)
+            {
+                size_t begin = bounds[i], middle = bounds[i + 1];
+                size_t end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+
+                std::merge(source + begin, source + middle, source + middle, source + end, target + begin);
+                bounds[++n_merged] = end;
+            }
+
+            bounds.resize(n_merged + 1);
+        }
+    }
+} // end of namespace kmer::detail
+
+// ###################################
+//
+// [1]
+//
+// A query split into parts occurs at p if the list of every part i contains p + shift_i, where shift_i is the
+// offset of the part inside the query. The candidates are taken from the shortest list and every further list,
+// in order of increasing size, removes the candidates it does not contain, so the candidate set only shrinks.
+// Since both the candidates and the lists are ascending, each list is traversed once in the forward direction:
+// if the list is at most 32 times longer than the candidates, it is merged linearly, comparing blocks of 8
+// elements without branches. The block compare is plain scalar code on purpose: whether it is vectorized is left
+// to the compiler and the target, no intrinsics are used and nothing relies on it. Longer lists are galloped:
+// starting at the last position, steps of 1, 2, 4, ... are taken until an element >= the target is found,
+// followed by a binary search inside the last step. This costs O(c log(n / c)) for c candidates instead of
+// O(c log n) for binary searching each candidate over the whole list, and O(n / 8) comparisons for the merge.
+// If a list is shorter than the candidates, which happens for the lists of all kmers sharing the rest prefix of
+// a query, the roles are swapped and the list is iterated while the candidates are searched. Elias fano encoded
+// lists are traversed with their own successor cursor.
+//
+// ###################################
+
+// ###################################
+//
+// [2]
+//
+// Queries shorter than k return one ascending run of positions per kmer with the query as prefix. Concatenating
+// them and sorting costs O(n log n) for n positions and ignores that the runs are sorted already. Instead, pairs
+// of adjacent runs are merged with std::merge until one run is left, starting with the runs themselves, so s runs
+// take log2(s) sequential passes over the positions, ping-ponging between the output and one scratch buffer and
+// starting in whichever of them makes the last pass end in the output. Merging linearly outperforms a heap of
+// the s run heads, whose pops and pushes cost O(log s) unpredictable branches per position. When the runs are
+// very short on average (below 256 positions), the log2(s) passes are more expensive than sorting and the
+// positions are sorted instead.
+//
+// ###################################
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <seqan3/alphabet/concept.hpp>
+#include <seqan3/alphabet/nucleotide/concept.hpp>
 #include <seqan3/alphabet/hash.hpp>
 #include <seqan3/range/views/kmer_hash.hpp>
 #include <seqan3/core/type_traits/range.hpp>
@@ -17,8 +18,19 @@
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
 #include <limits>
 #include <unordered_map>
+#include <span>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <ranges>
+#include <string>
+#include <tuple>
 
 #include <robin_hood.h>
 
@@ -26,548 +38,3066 @@
 #include <kmer_index_result.hpp>
 #include <thread_pool.hpp>
 #include <compressed_bitset.hpp>
+#include <elias_fano.hpp>
+#include <bloom_filter.hpp>
+#include <hash_types.hpp>
+#include <intersection.hpp>
+#include <bucketing.hpp>
+#include <packed_text.hpp>
+#include <serialization.hpp>
 
 
 namespace kmer
 {
+    // how positions are stored inside each kmer_index_element, with SHARED all elements share one plain array of
+    // positions (c.f. [17])
+    enum class POSITION_ENCODING : uint8_t {PLAIN = 0, ELIAS_FANO = 1, SHARED = 2};
+
+    // whether elements that are not directly addressed reject absent kmers with a bloom filter first
+    enum class MEMBERSHIP_FILTER : bool {NONE = false, BLOOM = true};
+
+    // whether kmers are stored as they occur or under the smaller hash of them and their reverse complement
+    enum class ORIENTATION : bool {FORWARD = false, CANONICAL = true};
+
+    // whether the index keeps a packed copy of the text so search_approximate can verify candidates (c.f. [13]),
+    // canonical indices keep it regardless
+    enum class APPROXIMATE_SEARCH : bool {DISABLED = false, ENABLED = true};
+
+    // how a kmer_index is constructed, e.g. kmer_index_options{.encoding = POSITION_ENCODING::ELIAS_FANO}
+    struct kmer_index_options
+    {
+        POSITION_ENCODING encoding = POSITION_ENCODING::PLAIN;
+        MEMBERSHIP_FILTER filter = MEMBERSHIP_FILTER::NONE;
+        ORIENTATION orientation = ORIENTATION::FORWARD;
+        APPROXIMATE_SEARCH approximate = APPROXIMATE_SEARCH::DISABLED;
+
+        // with w > 1 all but the smallest k only store the minimizers of every w consecutive kmers (c.f. [18])
+        size_t minimizer_window = 1;
+
+        // one shape per k in the order of the ks, 0 for an ungapped kmer, none if all are ungapped (c.f. [19])
+        std::vector<uint64_t> shapes = {};
+    };
+
     namespace detail
     {
+        // texts whose elements are ranges themselves are collections of sequences
+        template<typename text_t>
+        constexpr bool is_collection = std::ranges::range<std::ranges::range_value_t<text_t>>;
+
+        // call f for each sequence of a collection or once for a single text
+        template<std::ranges::range text_t, typename function_t>
+        void for_each_sequence(text_t& text, function_t&& f)
+        {
+            if constexpr (is_collection<text_t>)
+            {
+                for (auto& sequence : text)
+                    f(sequence);
+            }
+            else
+                f(text);
+        }
+
+        // memory reused by kmer_index::search(query, context) across queries, so that searching does not allocate
+        // once the buffers have grown to the size of the largest query result (c.f. [16])
+        // a context must not be used by multiple threads at the same time
+        template<typename position_t>
+        struct search_context
+        {
+            // sorted positions of the last query
+            std::vector<position_t> positions;
+
+            std::vector<position_list<position_t>> lists;
+            std::vector<position_list<position_t>> rest_lists;
+            std::vector<size_t> shifts;
+            std::vector<std::span<const position_t>> runs;
+            std::vector<position_t> scratch;
+            std::vector<size_t> bounds;
+            intersection_buffers<position_t> intersection;
+
+            // canonical queries: shifts of the parts on the reverse strand and the positions found there
+            std::vector<size_t> reverse_shifts;
+            std::vector<position_t> reverse_positions;
+        };
+
+        // number of dependent memory accesses of a lookup that are prefetched one after another (c.f. [8])
+        constexpr size_t _n_prefetch_stages = 4;
+
+        // texts with fewer kmers are not split into multiple chunks during construction (c.f. [6])
+        constexpr size_t _min_chunk_size = 1 << 16;
+
+        // leftmost kmer of smallest order among the last w kmers pushed, where the order is a bijective mix of the
+        // hash so that minimizers are not biased towards kmers of low ranks (c.f. [18] in kmer_index)
+        // positions pushed between two resets have to be consecutive
+        template<typename hash_t>
+        class minimizer_window
+        {
+            private:
+                struct entry
+                {
+                    uint64_t order;
+                    hash_t hash;
+                    size_t position;
+                };
+
+                // ascending by order, the front is the minimizer of the current window
+                std::deque<entry> _entries;
+                size_t _w;
+                size_t _n_pushed = 0;
+                size_t _last_minimizer = size_t(-1);
+
+            public:
+                explicit minimizer_window(size_t w)
+                    : _w(w)
+                {}
+
+                // start over at the beginning of another sequence
+                void reset()
+                {
+                    _entries.clear();
+                    _n_pushed = 0;
+                }
+
+                // push the next kmer, calls f(hash, position) once the window is full and its minimizer differs from
+                // that of the previous window, so that each position is reported once
+                template<typename function_t>
+                void push(uint64_t order, hash_t hash, size_t position, function_t&& f)
+                {
+                    while (not _entries.empty() and _entries.back().order > order)
+                        _entries.pop_back();
+
+                    _entries.push_back(entry{order, hash, position});
+
+                    if (_entries.front().position + _w <= position)
+                        _entries.pop_front();
+
+                    if (++_n_pushed >= _w and _entries.front().position != _last_minimizer)
+                    {
+                        _last_minimizer = _entries.front().position;
+                        f(_entries.front().hash, _entries.front().position);
+                    }
+                }
+        };
+
         // represents a kmer-index for a single set k
         // alphabet_t   :   the alphabet of the text
         // position_t   :   the primitive used for positional indices
         // k            :   the k user for hashing kmers
-        template<seqan3::alphabet alphabet_t, typename position_t, size_t k>
+        // hash_t       :   the unsigned integer used for hashes, by default the smallest that can hold sigma^k (c.f. [4])
+        template<seqan3::alphabet alphabet_t,
+                 typename position_t,
+                 size_t k,
+                 typename hash_t = minimal_hash_t<seqan3::alphabet_size<alphabet_t>, k>>
         class kmer_index_element
         {
-            static_assert(k > 0 and k < 64 / log2(seqan3::alphabet_size<alphabet_t>),
-                    "the hashspace for the current k cannot be represented with only a 64-bit integer. Please specify a valid k");
+            static_assert(k > 0 and k < 8 * sizeof(hash_t) / log2(seqan3::alphabet_size<alphabet_t>),
+                    "the hashspace for the current k cannot be represented with hash_t. Please specify a valid k");
 
             friend class kmer_index;
 
             private:
                 // typedefs for readabilty
                 using result_t = kmer_index_result<position_t>;
+                using positions_t = std::span<const position_t>;
+                using list_t = position_list<position_t>;
                 constexpr static size_t _sigma = seqan3::alphabet_size<alphabet_t>;
 
-                robin_hood::unordered_map<size_t, std::vector<position_t>> _data;
+                // _powers[i] = sigma^i
+                constexpr static std::array<hash_t, k + 1> _powers = power_table<hash_t, _sigma, k + 1>();
+                constexpr static hash_t _hash_space = _powers[k];
+
+                // hashes of queries can be cut out of the packed ranks (c.f. packed_text.hpp [1])
+                constexpr static bool _packed_hashing = packed_query<alphabet_t>::is_supported
+                                                        and std::is_same_v<hash_t, uint64_t>;
+
+                // kmers and their reverse complement share one hash, only for nucleotides with 64-bit hashes (c.f. [14])
+                constexpr static bool _canonical_supported = seqan3::nucleotide_alphabet<alphabet_t>
+                                                             and std::is_same_v<hash_t, uint64_t>;
+
+                // _complement_ranks[r] is the rank of the complement of the character of rank r
+                constexpr static std::array<uint8_t, _sigma> _complement_ranks = []()
+                {
+                    std::array<uint8_t, _sigma> out{};
+                    if constexpr (seqan3::nucleotide_alphabet<alphabet_t>)
+                        for (size_t rank = 0; rank < _sigma; ++rank)
+                            out[rank] = seqan3::to_rank(seqan3::complement(alphabet_t{}.assign_rank(rank)));
+
+                    return out;
+                }();
+
+                bool _canonical = false;
+
+                // with a window w > 1 only the minimizers of every w consecutive kmers of a sequence are stored and
+                // search only hands out candidates of queries containing a full window (c.f. [18] in kmer_index)
+                size_t _window = 1;
+
+                // with a shape, the kmer of position i is made up of the characters i + _care[j] of the _span
+                // characters starting at i, so seeds of equal weight k tolerate more substitutions (c.f. [19] in kmer_index)
+                uint64_t _shape = 0;
+                size_t _span = k;
+                std::array<size_t, k> _care{};
+
+                // only minimizers or spaced seeds are stored, search hands out candidates that are verified by kmer_index
+                bool is_sampled() const
+                {
+                    return _window > 1 or _span > k;
+                }
+
+                // set _shape, _span and _care, 0 or a mask of k consecutive bits is the ungapped kmer
+                // the shape is read from its highest set bit to bit 0, e.g. 0b1101 hashes the 1st, 2nd and 4th character
+                void setup_shape(uint64_t shape)
+                {
+                    check_shape(shape);
+
+                    _shape = shape;
+                    _span = k;
+
+                    if (shape == 0)
+                        return;
+
+                    _span = std::bit_width(shape);
+
+                    size_t i = 0;
+                    for (size_t offset = 0; offset < _span; ++offset)
+                        if ((shape >> (_span - 1 - offset)) & 1)
+                            _care[i++] = offset;
+                }
+
+                // hash of the spaced seed starting at seed_begin
+                template<typename iterator_t>
+                hash_t spaced_hash(iterator_t seed_begin) const
+                {
+                    hash_t out = 0;
+                    for (size_t offset : _care)
+                        out = out * hash_t(_sigma) + hash_t(seqan3::to_rank(seed_begin[offset]));
+
+                    return out;
+                }
+
+                // order of kmers when choosing minimizers
+                static uint64_t minimizer_order(hash_t h)
+                {
+                    uint64_t x = filter_key(h);
+                    x ^= x >> 33;
+                    x *= 0xff51afd7ed558ccd;
+                    x ^= x >> 33;
+                    x *= 0xc4ceb9fe1a85ec53;
+                    x ^= x >> 33;
+                    return x;
+                }
+
+                // hash maps with keys wider than 64 bit need their own hash function
+                using map_hash_t = std::conditional_t<std::is_same_v<hash_t, uint64_t>, robin_hood::hash<hash_t>, wide_hash<hash_t>>;
+
+                // if the hashspace is at most this many times larger than the number of kmers in the text,
+                // positions are stored directly addressed instead of in a hash map (c.f. [2])
+                constexpr static size_t _direct_addressing_factor = 4;
+
+                bool _direct_addressing = false;
+
+                // direct addressing: positions of hash h are _positions[_offsets[h], _offsets[h+1])
+                // otherwise: positions of _keys[i] are _positions[_offsets[i], _offsets[i+1])
+                flat_array<position_t> _offsets;
+                flat_array<position_t> _positions;
+
+                // with POSITION_ENCODING::ELIAS_FANO: _positions is replaced by one elias fano sequence of
+                // bucket * _text_size + position, the bucket being h or i from above (c.f. elias_fano.hpp)
+                bool _elias_fano = false;
+                elias_fano _encoded_positions;
+                size_t _text_size = 0;
+
+                // with POSITION_ENCODING::SHARED: _positions views the positions of all ks, sorted by the kmer of the
+                // largest k starting at them, and the first _skip_counts[i] positions of bucket _skip_buckets[i] are
+                // too close to the end of their sequence to start a kmer of size k (c.f. [17] in kmer_index)
+                // the buckets are only ascending for the largest k
+                bool _shared = false;
+                bool _sorted_buckets = true;
+                flat_array<uint64_t> _skip_buckets;
+                flat_array<position_t> _skip_counts;
+                std::shared_ptr<const std::vector<position_t>> _shared_positions;
+
+                // hash spaces too large to be addressed directly: all occurring hashes in ascending order,
+                // _directory[c] is the first index in _keys whose hash is >= c << _directory_shift (c.f. [3])
+                flat_array<hash_t> _keys;
+                flat_array<position_t> _directory;
+                size_t _directory_shift = 0;
+
+                // canonical and not directly addressed: the reverse complements of all keys in ascending order,
+                // _reverse_key_indices[i] is the index in _keys of the key whose reverse complement is _reverse_keys[i],
+                // so the keys with a given suffix are found by the prefix of their reverse complement (c.f. [14])
+                flat_array<hash_t> _reverse_keys;
+                flat_array<position_t> _reverse_key_indices;
+
+                // with MEMBERSHIP_FILTER::BLOOM: all hashes in _keys, rejects most absent hashes with one memory access
+                blocked_bloom_filter _filter;
+
+                // keeps memory mapped arrays valid
+                std::shared_ptr<const mapped_file> _mapped_file;
 
                 // hash a query of length k
                 // optimization through contesxpr unwrapping parts of fold expression
                 template<typename iterator_t>
-                size_t hash_aux_aux(iterator_t query_it, size_t i) const
+                hash_t hash_aux_aux(iterator_t query_it, size_t i) const
                 {
-                    return seqan3::to_rank(*query_it) * kmer::detail::fast_pow(_sigma, k - i - 1);
+                    return hash_t(seqan3::to_rank(*query_it)) * _powers[k - i - 1];
                 }
 
                 template<typename iterator_t, size_t... is>
-                size_t hash_aux(iterator_t query_it, std::index_sequence<is...> sequence) const
+                hash_t hash_aux(iterator_t query_it, std::index_sequence<is...> sequence) const
                 {
-                    return (... + hash_aux_aux(query_it++, is));
+                    // each term advances its own iterator, the evaluation order of the operands is unspecified
+                    return (... + hash_aux_aux(std::next(query_it, is), is));
                 }
 
                 template<typename iterator_t>
-                size_t hash(iterator_t query_it) const
+                hash_t hash(iterator_t query_it) const
                 {
                     auto it = query_it;
                     return hash_aux(it, std::make_index_sequence<k>());
                 }
 
-                // access data
-                const std::vector<position_t>* at(size_t hash) const
+                // hash of a prefix of length size <= k, as the smallest hash of all kmers with that prefix
+                template<typename iterator_t>
+                hash_t prefix_hash(iterator_t prefix_begin, size_t size) const
+                {
+                    if (size == k)
+                        return hash(prefix_begin);
+
+                    hash_t out = 0;
+                    for (size_t i = 0; i < size; ++i, ++prefix_begin)
+                        out += hash_t(seqan3::to_rank(*prefix_begin)) * _powers[k - i - 1];
+
+                    return out;
+                }
+
+                // call f with the hash of every kmer in text, in order of position
+                template<std::ranges::range text_t, typename function_t>
+                void for_each_hash(text_t& text, function_t&& f) const
                 {
-                    auto it = _data.find(hash);
+                    size_t size = std::ranges::size(text);
+                    if (size < _span)
+                        return;
 
-                    if (it != _data.end())
-                        return &it->second;
+                    if (_span > k)
+                    {
+                        auto it = std::ranges::begin(text);
+                        for (size_t i = 0; i + _span <= size; ++i)
+                            f(spaced_hash(it + i));
+                    }
+                    else if constexpr (std::is_same_v<hash_t, uint64_t>)
+                    {
+                        for (size_t h : text | seqan3::views::kmer_hash(seqan3::shape{seqan3::ungapped{k}}))
+                            f(h);
+                    }
                     else
-                        return nullptr;
+                    {
+                        // seqan3::views::kmer_hash only produces 64-bit hashes, roll the hash manually
+                        hash_t h = 0;
+                        for (size_t i = 0; i < k; ++i)
+                            h = h * hash_t(_sigma) + hash_t(seqan3::to_rank(text[i]));
+
+                        f(h);
+
+                        for (size_t i = k; i < size; ++i)
+                        {
+                            h = (h - hash_t(seqan3::to_rank(text[i - k])) * _powers[k - 1]) * hash_t(_sigma)
+                                + hash_t(seqan3::to_rank(text[i]));
+                            f(h);
+                        }
+                    }
                 }
 
-                // check last kmer to account for edge case
-                std::vector<alphabet_t> _last_kmer;
-                std::vector<std::vector<position_t>> _last_kmer_refs;
+                // hash of the reverse complement of the kmer with hash h
+                static hash_t reverse_complement(hash_t h)
+                {
+                    hash_t out = 0;
+                    if constexpr (_canonical_supported)
+                        for (size_t i = 0; i < k; ++i, h /= _sigma)
+                            out = out * _sigma + _complement_ranks[h % _sigma];
 
-                template<typename iterator_t>
-                void check_last_kmer(iterator_t subk_begin, size_t size,
-                                     std::vector<const std::vector<position_t>*>& to_fill) const
+                    return out;
+                }
+
+                // hash the kmer is stored under
+                hash_t canonical(hash_t h) const
+                {
+                    return _canonical ? std::min(h, reverse_complement(h)) : h;
+                }
+
+                // call f(hash, position) for the kmers number first to last (exclusive) of all kmers that lie
+                // completely inside one sequence of text, positions of collections are global (c.f. [5])
+                // in canonical mode hash is the canonical hash
+                template<std::ranges::range text_t, typename function_t>
+                void for_each_kmer(text_t& text, size_t first, size_t last, function_t&& f) const
                 {
-                    for (size_t i = 1; i < k - size + 1; ++i)
+                    size_t start = 0, n_previous = 0;
+                    for_each_sequence(text, [&](auto& sequence)
                     {
-                        bool equal = true;
-                        auto it = subk_begin;
+                        size_t size = std::ranges::size(sequence);
+                        size_t n_kmers = size >= _span ? size - _span + 1 : 0;
 
-                        for (size_t j = i; j < i + size; ++j)
+                        size_t begin = std::max(first, n_previous);
+                        size_t end = std::min(last, n_previous + n_kmers);
+
+                        if (begin < end)
                         {
-                            if (_last_kmer.at(j) != *it)
-                            {
-                                equal = false;
-                                break;
-                            }
-                            it++;
+                            auto sequence_begin = std::ranges::begin(sequence);
+                            auto part = std::ranges::subrange(sequence_begin + (begin - n_previous),
+                                                              sequence_begin + (end - n_previous + _span - 1));
+
+                            size_t i = start + begin - n_previous;
+                            for_each_hash(part, [&](hash_t h) { f(canonical(h), i++); });
                         }
 
-                        if (equal)
-                            to_fill.push_back(&_last_kmer_refs.at(i));
-                    }
+                        n_previous += n_kmers;
+                        start += size + 1;
+                    });
                 }
 
-                // access positions based on prefix of length < k
-                template<typename iterator_t>
-                std::vector<const std::vector<position_t>*>
-                get_position_for_all_kmer_with_prefix(iterator_t prefix_begin, size_t size) const
+                // for_each_kmer, with a window w > 1 only for each minimizer of the windows of one sequence that end at
+                // the kmers number first to last (exclusive), which is reported by the first window choosing it
+                // the window ending just before first is filled as well, so chunks never report a position twice
+                template<std::ranges::range text_t, typename function_t>
+                void for_each_stored_kmer(text_t& text, size_t first, size_t last, function_t&& f) const
                 {
-                    if (fast_pow(_sigma, k-size) > 1e7)
+                    if (_window <= 1)
                     {
-                        throw std::invalid_argument("query size too low for specified k");
+                        for_each_kmer(text, first, last, f);
+                        return;
                     }
 
-                    auto it = prefix_begin;
-                    size_t prefix_hash = 0;
-                    for (size_t i = 0; i < size; ++i)
+                    minimizer_window<hash_t> window(_window);
+                    size_t n = std::max(first, _window) - _window;
+                    size_t previous = size_t(-1);
+
+                    for_each_kmer(text, n, last, [&](hash_t h, size_t pos)
                     {
-                        prefix_hash += seqan3::to_rank(*it++) * fast_pow(_sigma, k - i - 1);
-                    }
+                        if (pos != previous + 1)
+                            window.reset();
 
-                    size_t lower_bound = 0 + prefix_hash;
-                    size_t n_hashes =  kmer::detail::fast_pow(_sigma, k - size);
-                    size_t upper_bound = lower_bound + n_hashes;
-                    size_t step_size = 1;
+                        previous = pos;
+                        window.push(minimizer_order(h), h, pos, [&](hash_t minimizer, size_t minimizer_pos)
+                        {
+                            if (n >= first)
+                                f(minimizer, minimizer_pos);
+                        });
 
-                    std::vector<const std::vector<position_t>*> output;
+                        ++n;
+                    });
+                }
 
-                    for (size_t hash = lower_bound;
-                         hash < upper_bound; hash += step_size)
-                    {
-                        const auto* pos = at(hash);
-                        if (pos != nullptr)
-                            output.push_back(pos);
-                    }
+                // index of hash in _keys, _keys.size() if it does not occur
+                size_t find_key(hash_t hash) const
+                {
+                    size_t cell = static_cast<size_t>(hash >> _directory_shift);
 
-                    check_last_kmer(prefix_begin, size, output);
-                    return output;
+                    auto begin = _keys.begin() + _directory[cell];
+                    auto end = _keys.begin() + _directory[cell + 1];
+                    auto it = std::lower_bound(begin, end, hash);
+
+                    if (it != end and *it == hash)
+                        return it - _keys.begin();
+                    else
+                        return _keys.size();
                 }
 
-            protected:
-                // CTOR protected because user should only engage with kmer_index_element<k> through kmer_index<k>
-                kmer_index_element() = default;
+                // key of hash in _filter
+                static uint64_t filter_key(hash_t hash)
+                {
+                    if constexpr (std::is_same_v<hash_t, uint64_t>)
+                        return hash;
+                    else
+                        return wide_hash<hash_t>()(hash);
+                }
 
-                template<std::ranges::range text_t>
-                void create(text_t& text)
+                // index of the first key >= hash, _keys.size() if there is none
+                size_t key_lower_bound(hash_t hash) const
                 {
-                    auto hashes = text | seqan3::views::kmer_hash(seqan3::shape{seqan3::ungapped{k}});
+                    if (hash >= _hash_space)
+                        return _keys.size();
 
-                    size_t i = 0;
-                    for (auto h : hashes)
-                    {
-                        if (_data.find(h) == _data.end())
-                            _data.emplace(h, std::vector<position_t>());
+                    // keys of later cells are all >= hash, so the search never has to leave the cell
+                    size_t cell = static_cast<size_t>(hash >> _directory_shift);
 
-                        _data[h].push_back(i);
-                        ++i;
-                    }
+                    auto begin = _keys.begin() + _directory[cell];
+                    auto end = _keys.begin() + _directory[cell + 1];
+                    return std::lower_bound(begin, end, hash) - _keys.begin();
+                }
 
-                    assert(i + k -1 < std::numeric_limits<position_t>::max() &&
-                        "your text is too large for this configuration");
+                // positions of bucket b, which is the hash with direct addressing and the index of the key otherwise
+                list_t bucket_list(size_t b) const
+                {
+                    if (_elias_fano)
+                        return list_t(&_encoded_positions, _offsets[b], _offsets[b + 1], b * _text_size);
 
-                    position_t text_size = position_t(i) + k - 1;
+                    size_t begin = _offsets[b];
 
-                    _last_kmer = std::vector<alphabet_t>(text.end() - k, text.end());
-                    _last_kmer_refs = std::vector<std::vector<position_t>>();
+                    // positions that do not start a kmer have rank 0 past the end of their sequence, so with direct
+                    // addressing only hashes ending in rank 0 can have any
+                    if (_shared and (not _direct_addressing or b % _sigma == 0))
+                        begin += n_skipped(b);
 
-                    for (position_t j = 0; j < _last_kmer.size(); ++j)
-                        _last_kmer_refs.emplace_back(std::vector<position_t>{j + text_size - position_t(k)});
+                    return list_t(positions_t(_positions.data() + begin, _positions.data() + _offsets[b + 1]));
                 }
 
-            public:
-                template<typename iterator_t>
-                const std::vector<position_t>* search_k(iterator_t it) const
+                // number of shared positions at the front of bucket b that do not start a kmer of size k
+                size_t n_skipped(size_t b) const
+                {
+                    auto it = std::lower_bound(_skip_buckets.begin(), _skip_buckets.end(), uint64_t(b));
+                    if (it == _skip_buckets.end() or *it != b)
+                        return 0;
+
+                    return _skip_counts[it - _skip_buckets.begin()];
+                }
+
+                // positions of _keys[key_i], empty list if key_i is _keys.size()
+                list_t key_list(size_t key_i) const
                 {
-                    const auto *pos = at(hash(it));
-                    if (pos)
-                        return pos;
+                    if (key_i != _keys.size())
+                        return bucket_list(key_i);
                     else
-                        return nullptr;
+                        return list_t();
                 }
 
-                // search any query
-                virtual result_t search(std::vector<alphabet_t>& query) const
+                // access data, returns empty list if kmer does not occur
+                list_t at(hash_t hash) const
                 {
-                    assert(query.size() > 0);
+                    hash = canonical(hash);
 
-                    // query size exactly k
-                    if (query.size() == k)
-                    {
-                        const auto* pos = at(hash(query.begin()));
-                        if (pos)
-                            return result_t(pos, true, BYPASS_BITMASK::YES);
-                        else
-                            return result_t();
-                    }
-                    // query size m > k
-                    else if (query.size() > k)
-                    {
-                        size_t rest_n = query.size() % k;
+                    // the hashspace is small enough to be addressed so hash fits into size_t
+                    if (_direct_addressing)
+                        return bucket_list(static_cast<size_t>(hash));
 
-                        // get positions for nk parts
-                        std::vector<const std::vector<position_t>*> nk_positions;
+                    // most absent kmers are rejected before touching the directory or keys (c.f. [12])
+                    if (not _filter.may_contain(filter_key(hash)))
+                        return list_t();
 
-                        int last_hash = -1;
+                    return key_list(find_key(hash));
+                }
 
-                        for (size_t i = 0; i < query.size() - rest_n; i += k)
-                        {
-                            size_t h = hash(query.begin() + i);
-                            const auto* pos = (h != last_hash ? at(h) : nk_positions.back());
+                // directory with about one cell per key
+                void build_directory()
+                {
+                    size_t n_bits = detail::bit_width(_hash_space - hash_t(1));
+                    size_t n_cell_bits = std::max<size_t>(std::bit_width(_keys.size()), 1) - 1;
+                    _directory_shift = n_bits > n_cell_bits ? n_bits - n_cell_bits : 0;
 
-                            if (pos)
-                                nk_positions.push_back(pos);
-                            else
-                                return result_t();
+                    size_t n_cells = static_cast<size_t>((_hash_space - hash_t(1)) >> _directory_shift) + 1;
+                    std::vector<position_t> directory(n_cells + 1, 0);
 
-                            last_hash = h;
-                        }
+                    size_t cell = 0;
+                    for (size_t i = 0; i < _keys.size(); ++i)
+                    {
+                        size_t current = static_cast<size_t>(_keys[i] >> _directory_shift);
+                        while (cell <= current)
+                            directory[cell++] = i;
+                    }
 
-                        // get positions for rest
-                        auto usable = detail::compressed_bitset(nk_positions.back()->size(), true);
+                    while (cell < directory.size())
+                        directory[cell++] = _keys.size();
 
-                        if (rest_n > 0)
-                        {
-                            auto rest_results = get_position_for_all_kmer_with_prefix(query.end() - rest_n, rest_n);
+                    _directory = flat_array<position_t>(std::move(directory));
+                }
 
-                            size_t i = 0;
-                            for (auto pos : *nk_positions.back())
-                            {
-                                bool can_be_used = false;
-                                for (const auto* res_vec : rest_results)
-                                {
-                                    if (std::binary_search(res_vec->begin(), res_vec->end(), pos + k))
-                                    {
-                                        can_be_used = true;
-                                        break;
-                                    }
-                                }
+                void build_reverse_keys()
+                {
+                    std::vector<std::pair<hash_t, position_t>> reverse;
+                    reverse.reserve(_keys.size());
+                    for (size_t key_i = 0; key_i < _keys.size(); ++key_i)
+                        reverse.emplace_back(reverse_complement(_keys[key_i]), key_i);
 
-                                if (can_be_used)
-                                    usable.set_1(i);
-                                else
-                                    usable.set_0(i);
+                    std::sort(reverse.begin(), reverse.end());
 
-                                ++i;
-                            }
-                        }
+                    std::vector<hash_t> reverse_keys;
+                    std::vector<position_t> reverse_key_indices;
+                    reverse_keys.reserve(reverse.size());
+                    reverse_key_indices.reserve(reverse.size());
 
-                        // query.size % k != 0 and query.size < 2*k
-                        if (nk_positions.size() == 1)
-                        {
-                            result_t output(nk_positions.at(0), false, BYPASS_BITMASK::NO);
-                            for (size_t i = 0; i < nk_positions.at(0)->size(); ++i)
-                                if (usable.at(i))
-                                    output.should_use(i);
+                    for (auto& [hash, key_i] : reverse)
+                    {
+                        reverse_keys.push_back(hash);
+                        reverse_key_indices.push_back(key_i);
+                    }
 
-                            return output;
-                        }
+                    _reverse_keys = flat_array<hash_t>(std::move(reverse_keys));
+                    _reverse_key_indices = flat_array<position_t>(std::move(reverse_key_indices));
+                }
 
-                        // query.size % k == 0
-                        else if (rest_n == 0)
-                        {
-                            result_t output(nk_positions.at(0), true, BYPASS_BITMASK::NO);
+                // encode _positions as elias fano sequence, keeps them plain if that would not save memory
+                void encode_positions()
+                {
+                    size_t n_buckets = _offsets.size() - 1;
+                    if (_positions.empty() or n_buckets > std::numeric_limits<uint64_t>::max() / _text_size)
+                        return;
 
-                            for (size_t start_pos_i = 0; start_pos_i < nk_positions.front()->size(); ++start_pos_i)
-                            {
-                                size_t previous_pos = nk_positions.front()->at(start_pos_i);
-                                bool should_use = true;
+                    auto encoded = elias_fano(_positions.size(), n_buckets * _text_size);
 
-                                for (size_t next_pos_i = 1; next_pos_i < nk_positions.size(); ++next_pos_i)
-                                {
-                                    auto* current = nk_positions.at(next_pos_i);
-
-                                    if (not std::binary_search(current->begin(), current->end(), previous_pos + k))
-                                    {
-                                        output.should_not_use(start_pos_i);
-                                        should_use = false;
-                                        break;
-                                    }
-                                    else
-                                        previous_pos += k;
-                                }
+                    for (size_t b = 0; b < n_buckets; ++b)
+                        for (size_t i = _offsets[b]; i < _offsets[b + 1]; ++i)
+                            encoded.push_back(b * _text_size + _positions[i]);
 
-                                if (should_use)
-                                    output.should_use(start_pos_i);
-                            }
+                    encoded.finalize();
 
-                            return output;
-                        }
+                    if (encoded.n_bytes() >= _positions.size() * sizeof(position_t))
+                        return;
 
-                        // query.size() % k != 0 and query.size() > 2*k
-                        else
+                    _encoded_positions = std::move(encoded);
+                    _elias_fano = true;
+                    _positions = flat_array<position_t>();
+                }
+
+                // check the last k-1 characters of each sequence to account for edge case, positions there do not
+                // start a kmer but can start a query shorter than k
+                // characters of tail t are _tails[_tail_offsets[t], _tail_offsets[t+1]), _tail_positions holds the
+                // position of each character so matches can be handed out as views
+                std::vector<alphabet_t> _tails;
+                std::vector<position_t> _tail_positions;
+                std::vector<size_t> _tail_offsets;
+
+                template<typename iterator_t>
+                void check_tails(iterator_t subk_begin, size_t size, std::vector<list_t>& to_fill) const
+                {
+                    for_each_tail_match(subk_begin, size, [&](size_t i) {
+                        to_fill.emplace_back(positions_t(_tail_positions.data() + i, 1));
+                    });
+                }
+
+                // call f(i) for every tail starting at _tail_positions[i] that starts with [subk_begin, subk_begin + size)
+                template<typename iterator_t, typename function_t>
+                void for_each_tail_match(iterator_t subk_begin, size_t size, function_t&& f) const
+                {
+                    for (size_t t = 0; t + 1 < _tail_offsets.size(); ++t)
+                    {
+                        for (size_t i = _tail_offsets[t]; i + size <= _tail_offsets[t + 1]; ++i)
                         {
-                            result_t output(nk_positions.at(0), true, BYPASS_BITMASK::NO);
+                            bool equal = true;
+                            auto it = subk_begin;
 
-                            for (size_t start_pos_i = 0; start_pos_i < nk_positions.front()->size(); ++start_pos_i)
+                            for (size_t j = i; j < i + size; ++j)
                             {
-                                size_t previous_pos = nk_positions.front()->at(start_pos_i);
-
-                                if (nk_positions.size() > 1)
+                                if (_tails[j] != *it)
                                 {
-                                    bool interrupted = false;
-                                    for (size_t next_pos_i = 1; next_pos_i < nk_positions.size(); ++next_pos_i)
-                                    {
-                                        const auto* current = nk_positions.back();
-                                        auto it = std::lower_bound(current->begin(), current->end(), previous_pos += k);
-
-                                        if (*it != previous_pos)
-                                        {
-                                            interrupted = true;
-                                            break;
-                                        }
-
-                                        if (next_pos_i == nk_positions.size() - 1)
-                                        {
-                                            if (not usable.at(it - current->begin()))
-                                                interrupted = true;
-
-                                            break;
-                                        }
-                                    }
-
-                                    if (interrupted)
-                                        output.should_not_use(start_pos_i);
+                                    equal = false;
+                                    break;
                                 }
+                                it++;
                             }
 
-                            return output;
+                            if (equal)
+                                f(i);
                         }
                     }
+                }
 
-                    // query.size() < k
-                    else
-                    {
-                        return result_t(get_position_for_all_kmer_with_prefix(query.begin(), query.size()));
-                    }
+                // range of _offsets belonging to all kmers with the given prefix of length < k
+                std::pair<size_t, size_t> prefix_range(hash_t hash_of_prefix, size_t size) const
+                {
+                    hash_t lower_bound = hash_of_prefix;
+                    hash_t upper_bound = lower_bound + _powers[k - size];
+
+                    // all hashes with the prefix are adjacent in _offsets, scan instead of probing each one
+                    if (_direct_addressing)
+                        return {static_cast<size_t>(lower_bound), static_cast<size_t>(upper_bound)};
+
+                    // same for _keys, only hashes that occur are visited (c.f. [10])
+                    return {key_lower_bound(lower_bound), key_lower_bound(upper_bound)};
                 }
-        };
-    } // end of namespace detail
 
-    template<seqan3::alphabet alphabet_t, typename position_t, size_t... ks>
-    class kmer_index
-        : public detail::kmer_index_element<alphabet_t, position_t, ks>...
-    {
-        private:
-            template<size_t k>
-            using index_element_t = detail::kmer_index_element<alphabet_t, position_t, k>;
-            using index_t = kmer_index<alphabet_t, position_t, ks...>;
-            using result_t = detail::kmer_index_result<position_t>;
+                // access positions based on prefix of length < k
+                template<typename iterator_t>
+                std::vector<list_t> get_position_for_all_kmer_with_prefix(iterator_t prefix_begin, size_t size) const
+                {
+                    return get_position_for_all_kmer_with_prefix(prefix_begin, size, prefix_hash(prefix_begin, size));
+                }
 
-            inline static std::vector<size_t> _all_ks = std::vector<size_t>{ks...};
+                // overload for an already computed prefix hash
+                template<typename iterator_t>
+                std::vector<list_t> get_position_for_all_kmer_with_prefix(iterator_t prefix_begin, size_t size, hash_t hash_of_prefix) const
+                {
+                    std::vector<list_t> output;
+                    get_position_for_all_kmer_with_prefix(prefix_begin, size, hash_of_prefix, output);
+                    return output;
+                }
 
-            // workaround to allow for RVO call of specific element with non-constexpr k (c.f. [1])
-            template<size_t k>
-            result_t call_search(std::vector<alphabet_t>& query) const
-            {
-                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search(query);
-            }
+                // overload that appends to output
+                template<typename iterator_t>
+                void get_position_for_all_kmer_with_prefix(iterator_t prefix_begin, size_t size, hash_t hash_of_prefix,
+                                                           std::vector<list_t>& output) const
+                {
+                    auto [begin, end] = prefix_range(hash_of_prefix, size);
 
-            using search_fn = result_t(kmer_index<alphabet_t, position_t, ks...>::*)(
-                    std::vector<alphabet_t>&) const;
+                    // hashes are the buckets with direct addressing, otherwise their keys are
+                    for (size_t b = begin; b < end; ++b)
+                    {
+                        auto list = bucket_list(b);
+                        if (not list.empty())
+                            output.push_back(list);
+                    }
 
-            const std::array<search_fn, sizeof...(ks)> _search_fns = {
-                    (&kmer_index<alphabet_t, position_t, ks...>::call_search<ks>)...};
+                    check_tails(prefix_begin, size, output);
+                }
 
-                        template<size_t k>
-            const std::vector<position_t>* call_search_k(typename std::vector<alphabet_t>::iterator query_begin) const
-            {
-                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search_k(query_begin);
-            }
+                // canonical kmers have no prefix order, so each kmer with the query of size m < k as prefix is looked
+                // up on its own. A position p of its bucket starts either the kmer, and with it the query, or its
+                // reverse complement, which ends in the reverse complement of the query at p + k - m. Both are
+                // written to output as sorted candidates that kmer_index verifies, ends of sequences are not covered
+                // (c.f. [14])
+                void canonical_prefix_candidates(std::vector<alphabet_t>& query, std::vector<position_t>& output) const
+                {
+                    size_t first = output.size();
+                    hash_t begin = prefix_hash(query.begin(), query.size());
+                    hash_t n_hashes = _powers[k - query.size()];
 
-            using search_k_fn = const std::vector<position_t>*(kmer_index<alphabet_t, position_t, ks...>::*)(
-                    typename std::vector<alphabet_t>::iterator) const;
+                    if (_direct_addressing)
+                    {
+                        for (hash_t h = begin; h < begin + n_hashes; ++h)
+                            at(h).decode(output);
+                    }
+                    else
+                    {
+                        // the kmer or its reverse complement is stored, so the keys either have the query as prefix,
+                        // which are adjacent in _keys, or the reverse complement of the query as suffix, which are
+                        // adjacent in _reverse_keys
+                        auto [first_key, last_key] = prefix_range(begin, query.size());
+                        for (size_t key_i = first_key; key_i < last_key; ++key_i)
+                            bucket_list(key_i).decode(output);
+
+                        auto first_reverse = std::lower_bound(_reverse_keys.begin(), _reverse_keys.end(), begin);
+                        auto last_reverse = std::lower_bound(first_reverse, _reverse_keys.end(), begin + n_hashes);
+                        for (auto it = first_reverse; it != last_reverse; ++it)
+                            bucket_list(_reverse_key_indices[it - _reverse_keys.begin()]).decode(output);
+                    }
 
-            const std::array<search_k_fn, sizeof...(ks)> _search_k_fns = {
-                    (&kmer_index<alphabet_t, position_t, ks...>::call_search_k<ks>)...};
+                    size_t last = output.size();
+                    for (size_t i = first; i < last; ++i)
+                        output.push_back(output[i] + (k - query.size()));
 
-            std::array<int, std::max({ks...}) + 1> _k_to_search_fns_i;
+                    std::sort(output.begin() + first, output.end());
+                    output.erase(std::unique(output.begin() + first, output.end()), output.end());
+                }
 
-            void setup_k_to_search_fn()
-            {
-                std::fill(_k_to_search_fns_i.begin(), _k_to_search_fns_i.end(), -1);
-                size_t i = 0;
-                for (size_t k : std::vector<size_t>{ks...})
+                // candidates of a query with at least one full window when only minimizers or spaced seeds are stored:
+                // each occurrence stores the minimizers of all windows of the query, the one with the fewest positions
+                // is shifted by its offset in the query, kmer_index verifies them (c.f. [18], [19] in kmer_index)
+                void sampled_candidates(std::vector<alphabet_t>& query, std::vector<position_t>& output) const
                 {
-                    _k_to_search_fns_i[k] = i;
-                    ++i;
-                }
-            }
+                    assert(query.size() + 1 >= _window + _span);
 
-            // calculate which query lengths to search with which k
-            inline static size_t _query_size_range = 10000;
-            inline static size_t _max_possible_k = 32;
+                    minimizer_window<hash_t> window(_window);
+                    list_t best;
+                    size_t best_offset = 0;
+                    bool first = true;
 
-            std::array<std::vector<size_t>, _query_size_range> _optimal_nk_sum;
-            std::array<bool, _query_size_range> _use_multi_search_scheme;
+                    size_t offset = 0;
+                    for_each_hash(query, [&](hash_t h)
+                    {
+                        window.push(minimizer_order(h), h, offset++, [&](hash_t minimizer, size_t minimizer_offset)
+                        {
+                            if (not first and best.empty())
+                                return;
 
-            void choose_search_scheme()
-            {
-                // TODO: do this at compile time
-                std::sort(_all_ks.begin(), _all_ks.end(), [](size_t a, size_t b) -> bool { return a > b; });
+                            auto list = at(minimizer);
+                            if (first or list.size() < best.size())
+                            {
+                                best = list;
+                                best_offset = minimizer_offset;
+                                first = false;
+                            }
+                        });
+                    });
 
-                std::vector<size_t> high_ks;
-                for (size_t i : _all_ks)
-                    if (i >= 9)
-                        high_ks.push_back(i);
+                    size_t begin = output.size();
+                    best.decode(output);
 
-                std::fill(_optimal_nk_sum.begin(), _optimal_nk_sum.end(), std::vector<size_t>());
+                    // positions are ascending, those too close to the start of the text come first
+                    auto valid = std::lower_bound(output.begin() + begin, output.end(), position_t(best_offset));
+                    output.erase(output.begin() + begin, valid);
 
-                std::fill(_use_multi_search_scheme.begin(), _use_multi_search_scheme.end(), false);
+                    for (size_t i = begin; i < output.size(); ++i)
+                        output[i] -= best_offset;
+                }
 
-                for (size_t k : high_ks)
+                // positions of query of size m > k, all block and rest hashes come from one pass over the query (c.f. [9])
+                std::vector<position_t> block_candidates(std::vector<alphabet_t>& query) const
+                {
+                    search_context<position_t> context;
+                    block_candidates(query, context);
+                    return std::move(context.positions);
+                }
+
+                // overload that writes the positions to context.positions
+                void block_candidates(std::vector<alphabet_t>& query, search_context<position_t>& context) const
+                {
+                    with_block_lookups(query, [&](auto&& window_hash, auto&& block_list)
+                    {
+                        block_candidates(query, context, window_hash, block_list);
+                    });
+                }
+
+                // call f(window_hash, block_list) where block_list(offset) looks up the block of query at offset
+                template<typename function_t>
+                void with_block_lookups(std::vector<alphabet_t>& query, function_t&& f) const
+                {
+                    with_window_hash(query, [&](auto&& window_hash)
+                    {
+                        hash_t last_hash = 0;
+                        list_t last;
+
+                        // equal consecutive blocks are only looked up once
+                        f(window_hash, [&](size_t offset)
+                        {
+                            hash_t h = window_hash(offset, k);
+                            if (offset == 0 or h != last_hash)
+                                last = at(h);
+
+                            last_hash = h;
+                            return last;
+                        });
+                    });
+                }
+
+                // overload for blocks already looked up by kmer_index::search_batch, lists holds them in the order of
+                // kmer_index::for_each_lookup
+                void block_candidates(std::vector<alphabet_t>& query, search_context<position_t>& context,
+                                      std::span<const list_t> lists) const
+                {
+                    with_window_hash(query, [&](auto&& window_hash)
+                    {
+                        // only the overlapping last block of canonical kmers does not start at a multiple of k
+                        block_candidates(query, context, window_hash, [&](size_t offset)
+                        {
+                            return offset % k == 0 ? lists[offset / k] : lists.back();
+                        });
+                    });
+                }
+
+                // call f with window_hash(offset, size), the prefix hash of the size characters of query at offset
+                template<typename function_t>
+                void with_window_hash(std::vector<alphabet_t>& query, function_t&& f) const
+                {
+                    if constexpr (_packed_hashing)
+                    {
+                        packed_query<alphabet_t> packed(query.begin(), query.size());
+                        f([&](size_t offset, size_t size) {
+                            return hash_t(packed.hash(offset, size)) * _powers[k - size];
+                        });
+                    }
+                    else
+                    {
+                        f([&](size_t offset, size_t size) {
+                            return prefix_hash(query.begin() + offset, size);
+                        });
+                    }
+                }
+
+                // search query of size m > k as non-overlapping blocks of size k and a rest shorter than k,
+                // block_list(offset) are the positions of the block at offset
+                template<typename window_hash_t, typename block_list_t>
+                void block_candidates(std::vector<alphabet_t>& query, search_context<position_t>& context,
+                                      window_hash_t&& window_hash, block_list_t&& block_list) const
+                {
+                    context.positions.clear();
+
+                    if (not block_lists(query, context, window_hash, block_list))
+                        return;
+
+                    // intersect the blocks starting from the smallest list (c.f. intersection.hpp [1])
+                    intersect(context.lists, context.shifts, context.positions, context.intersection);
+
+                    // the rest has to match any of the kmers with its prefix
+                    if (not context.rest_lists.empty())
+                        filter_candidates_any(context.positions, context.rest_lists, query.size() - query.size() % k,
+                                              context.intersection.keep);
+                }
+
+                // number of positions block_candidates would find, the last list is only counted against (c.f. [11])
+                template<typename window_hash_t, typename block_list_t>
+                size_t block_count(std::vector<alphabet_t>& query, search_context<position_t>& context,
+                                   window_hash_t&& window_hash, block_list_t&& block_list) const
+                {
+                    if (not block_lists(query, context, window_hash, block_list))
+                        return 0;
+
+                    if (context.rest_lists.empty())
+                        return count_common(context.lists, context.shifts, context.positions, context.intersection);
+
+                    intersect(context.lists, context.shifts, context.positions, context.intersection);
+                    return count_candidates_any(std::span<const position_t>(context.positions), context.rest_lists,
+                                                query.size() - query.size() % k, context.intersection.keep);
+                }
+
+                // collect the lists of the blocks and their shifts in context.lists and context.shifts and the lists
+                // of the kmers with the rest as prefix in context.rest_lists, false if any of them does not occur
+                template<typename window_hash_t, typename block_list_t>
+                bool block_lists(std::vector<alphabet_t>& query, search_context<position_t>& context,
+                                 window_hash_t&& window_hash, block_list_t&& block_list) const
+                {
+                    size_t rest_n = query.size() % k;
+
+                    // get positions for nk parts
+                    auto& nk_positions = context.lists;
+                    nk_positions.clear();
+
+                    for (size_t i = 0; i < query.size() - rest_n; i += k)
+                    {
+                        auto pos = block_list(i);
+
+                        if (not pos.empty())
+                            nk_positions.push_back(pos);
+                        else
+                            return false;
+                    }
+
+                    auto& shifts = context.shifts;
+                    shifts.clear();
+                    for (size_t i = 0; i < nk_positions.size(); ++i)
+                        shifts.push_back(i * k);
+
+                    // canonical kmers have no prefix order, the rest is covered by a last block overlapping the previous one
+                    if (_canonical and rest_n > 0)
+                    {
+                        auto pos = block_list(query.size() - k);
+                        if (pos.empty())
+                            return false;
+
+                        nk_positions.push_back(pos);
+                        shifts.push_back(query.size() - k);
+                        rest_n = 0;
+                    }
+
+                    // get positions for rest
+                    auto& rest_results = context.rest_lists;
+                    rest_results.clear();
+                    if (rest_n > 0)
+                    {
+                        get_position_for_all_kmer_with_prefix(query.end() - rest_n, rest_n,
+                                                              window_hash(query.size() - rest_n, rest_n), rest_results);
+                        if (rest_results.empty())
+                            return false;
+                    }
+
+                    return true;
+                }
+
+            protected:
+                // CTOR protected because user should only engage with kmer_index_element<k> through kmer_index<k>
+                kmer_index_element() = default;
+
+                // construct in parallel using n_threads tasks of pool (c.f. [6])
+                template<std::ranges::range text_t>
+                void create(text_t& text, POSITION_ENCODING encoding, MEMBERSHIP_FILTER filter, ORIENTATION orientation,
+                            size_t window, uint64_t shape, thread_pool& pool, size_t n_threads)
+                {
+                    if (orientation == ORIENTATION::CANONICAL and not _canonical_supported)
+                        throw std::invalid_argument("canonical kmers need a nucleotide alphabet and hashes that fit into "
+                                                    "64 bit, which is not the case for k = " + std::to_string(k));
+
+                    _canonical = orientation == ORIENTATION::CANONICAL;
+                    _window = std::max<size_t>(window, 1);
+                    setup_shape(shape);
+
+                    size_t n_kmers = setup_text_size(text);
+
+                    // the kmers are split into chunks that are hashed in parallel, the hashspace is split into shards
+                    // by the highest bits of the hash that are bucketed in parallel
+                    size_t n_chunks = std::clamp<size_t>(n_kmers / _min_chunk_size, 1, n_threads);
+                    auto chunk_begin = [&](size_t chunk) { return chunk * n_kmers / n_chunks; };
+
+                    // number of positions that are stored, fewer than n_kmers if only minimizers are
+                    size_t n_stored = n_kmers;
+                    if (_window > 1)
+                    {
+                        auto chunk_sizes = std::vector<size_t>(n_chunks, 0);
+                        parallel_for(pool, n_chunks, [&](size_t chunk)
+                        {
+                            for_each_stored_kmer(text, chunk_begin(chunk), chunk_begin(chunk + 1),
+                                                 [&](hash_t, size_t) { chunk_sizes[chunk]++; });
+                        });
+
+                        n_stored = std::accumulate(chunk_sizes.begin(), chunk_sizes.end(), size_t(0));
+                    }
+
+                    _direct_addressing = _hash_space <= hash_t(_direct_addressing_factor * n_stored);
+
+                    size_t n_bits = detail::bit_width(_hash_space - hash_t(1));
+                    size_t n_shard_bits = n_chunks > 1 ? std::min<size_t>(n_bits, std::bit_width(4 * n_chunks - 1)) : 0;
+                    size_t shard_shift = n_bits - n_shard_bits;
+                    size_t n_shards = static_cast<size_t>((_hash_space - hash_t(1)) >> shard_shift) + 1;
+
+                    auto shard_of = [&](hash_t h) { return static_cast<size_t>(h >> shard_shift); };
+
+                    // shard s occupies [shard_begins[s], shard_begins[s+1]) of the scattered kmers, inside of it the
+                    // chunks are laid out in order so positions stay ascending
+                    auto shard_begins = std::vector<size_t>(n_shards + 1, 0);
+                    shard_begins[n_shards] = n_stored;
+
+                    std::vector<hash_t> scattered_hashes;
+                    std::vector<position_t> scattered_positions;
+
+                    // a single chunk is a single shard, which is read from the text directly instead (c.f. [6])
+                    if (n_chunks > 1)
+                    {
+                        // count kmers per chunk and shard
+                        auto cursors = std::vector<std::vector<size_t>>(n_chunks, std::vector<size_t>(n_shards, 0));
+
+                        parallel_for(pool, n_chunks, [&](size_t chunk)
+                        {
+                            for_each_stored_kmer(text, chunk_begin(chunk), chunk_begin(chunk + 1),
+                                                 [&](hash_t h, size_t) { cursors[chunk][shard_of(h)]++; });
+                        });
+
+                        size_t n_scattered = 0;
+                        for (size_t shard = 0; shard < n_shards; ++shard)
+                        {
+                            shard_begins[shard] = n_scattered;
+                            for (size_t chunk = 0; chunk < n_chunks; ++chunk)
+                            {
+                                size_t n = cursors[chunk][shard];
+                                cursors[chunk][shard] = n_scattered;
+                                n_scattered += n;
+                            }
+                        }
+
+                        scattered_hashes.resize(n_stored);
+                        scattered_positions.resize(n_stored);
+
+                        parallel_for(pool, n_chunks, [&](size_t chunk)
+                        {
+                            for_each_stored_kmer(text, chunk_begin(chunk), chunk_begin(chunk + 1), [&](hash_t h, size_t i)
+                            {
+                                size_t j = cursors[chunk][shard_of(h)]++;
+                                scattered_hashes[j] = h;
+                                scattered_positions[j] = i;
+                            });
+                        });
+                    }
+
+                    // call f(hash, position) for every kmer of shard, in ascending order of position
+                    auto for_each_in_shard = [&](size_t shard, auto&& f)
+                    {
+                        if (n_chunks == 1)
+                            for_each_stored_kmer(text, 0, n_kmers, f);
+                        else
+                            for (size_t j = shard_begins[shard]; j < shard_begins[shard + 1]; ++j)
+                                f(scattered_hashes[j], scattered_positions[j]);
+                    };
+
+                    // the positions of each shard end up in the same range of _positions
+                    auto positions = std::vector<position_t>(n_stored);
+
+                    if (_direct_addressing)
+                    {
+                        size_t hash_space = static_cast<size_t>(_hash_space);
+                        auto offsets = std::vector<position_t>(hash_space + 1, 0);
+
+                        // counting sort per shard, each shard only touches offsets of its own hashes
+                        parallel_for(pool, n_shards, [&](size_t shard)
+                        {
+                            size_t hash_begin = shard << shard_shift;
+                            size_t hash_end = std::min(hash_space, (shard + 1) << shard_shift);
+
+                            for_each_in_shard(shard, [&](hash_t h, size_t) { offsets[static_cast<size_t>(h)]++; });
+
+                            size_t sum = shard_begins[shard];
+                            for (size_t h = hash_begin; h < hash_end; ++h)
+                            {
+                                size_t n = offsets[h];
+                                offsets[h] = sum;
+                                sum += n;
+                            }
+
+                            // fill using the start of each bucket as cursor, afterwards offsets[h] holds the end of h
+                            for_each_in_shard(shard, [&](hash_t h, size_t i) { positions[offsets[static_cast<size_t>(h)]++] = i; });
+
+                            // shift back so offsets[h] is the start of h again
+                            for (size_t h = hash_end - 1; h > hash_begin; --h)
+                                offsets[h] = offsets[h - 1];
+
+                            offsets[hash_begin] = shard_begins[shard];
+                        });
+
+                        offsets[hash_space] = n_stored;
+
+                        _offsets = flat_array<position_t>(std::move(offsets));
+                        _positions = flat_array<position_t>(std::move(positions));
+
+                        if (encoding == POSITION_ENCODING::ELIAS_FANO)
+                            encode_positions();
+                    }
+                    else
+                    {
+                        auto shard_buckets = std::vector<sparse_buckets<hash_t, position_t>>(n_shards);
+
+                        // two passes per shard with one map operation per kmer each (c.f. [7])
+                        parallel_for(pool, n_shards, [&](size_t shard)
+                        {
+                            shard_buckets[shard] = bucket_sparse<hash_t, position_t, map_hash_t>(
+                                    [&](auto&& f) { for_each_in_shard(shard, f); }, positions, shard_begins[shard]);
+                        });
+
+                        // concatenate shards, the end of each shard is the start of the next one
+                        std::vector<hash_t> keys;
+                        std::vector<position_t> offsets;
+
+                        for (auto& buckets : shard_buckets)
+                        {
+                            keys.insert(keys.end(), buckets.keys.begin(), buckets.keys.end());
+                            offsets.insert(offsets.end(), buckets.offsets.begin(), buckets.offsets.end() - 1);
+                        }
+                        offsets.push_back(n_stored);
+
+                        _keys = flat_array<hash_t>(std::move(keys));
+                        _offsets = flat_array<position_t>(std::move(offsets));
+                        _positions = flat_array<position_t>(std::move(positions));
+
+                        build_directory();
+
+                        if (_canonical)
+                            build_reverse_keys();
+
+                        if (encoding == POSITION_ENCODING::ELIAS_FANO)
+                            encode_positions();
+
+                        if (filter == MEMBERSHIP_FILTER::BLOOM)
+                            build_filter();
+                    }
+
+                    setup_tails(text);
+                }
+
+                // construct from the positions shared by all ks, sorted by the hash of the kmer of size max_k starting
+                // at them, hashes[i] and rests[i] are that hash and the number of characters up to the end of its
+                // sequence of (*positions)[i], capped at max_k (c.f. [17] in kmer_index)
+                template<std::ranges::range text_t>
+                void create_shared(text_t& text, std::shared_ptr<const std::vector<position_t>> positions,
+                                   std::span<const uint64_t> hashes, std::span<const uint8_t> rests, size_t max_k,
+                                   MEMBERSHIP_FILTER filter)
+                {
+                    size_t n_kmers = setup_text_size(text);
+                    _direct_addressing = _hash_space <= hash_t(_direct_addressing_factor * n_kmers);
+                    _shared = true;
+                    _sorted_buckets = k == max_k;
+
+                    // the first k characters of the kmer of size max_k
+                    uint64_t divisor = fast_pow(_sigma, max_k - k);
+
+                    std::vector<position_t> offsets;
+                    std::vector<hash_t> keys;
+                    std::vector<uint64_t> skip_buckets;
+                    std::vector<position_t> skip_counts;
+
+                    if (_direct_addressing)
+                        offsets.resize(static_cast<size_t>(_hash_space) + 1);
+
+                    size_t next = 0;
+                    for (size_t i = 0; i < hashes.size(); ++i)
+                    {
+                        uint64_t h = hashes[i] / divisor;
+
+                        if (_direct_addressing)
+                        {
+                            while (next <= h)
+                                offsets[next++] = i;
+                        }
+                        else if (keys.empty() or keys.back() != hash_t(h))
+                        {
+                            keys.push_back(hash_t(h));
+                            offsets.push_back(i);
+                        }
+
+                        // positions with fewer than k characters left come first in their bucket
+                        if (rests[i] < k)
+                        {
+                            uint64_t bucket = _direct_addressing ? h : keys.size() - 1;
+                            if (skip_buckets.empty() or skip_buckets.back() != bucket)
+                            {
+                                skip_buckets.push_back(bucket);
+                                skip_counts.push_back(0);
+                            }
+
+                            skip_counts.back()++;
+                        }
+                    }
+
+                    if (_direct_addressing)
+                        std::fill(offsets.begin() + next, offsets.end(), hashes.size());
+                    else
+                        offsets.push_back(hashes.size());
+
+                    _offsets = flat_array<position_t>(std::move(offsets));
+                    _keys = flat_array<hash_t>(std::move(keys));
+                    _skip_buckets = flat_array<uint64_t>(std::move(skip_buckets));
+                    _skip_counts = flat_array<position_t>(std::move(skip_counts));
+                    _positions = flat_array<position_t>(std::span<const position_t>(*positions));
+                    _shared_positions = std::move(positions);
+
+                    if (not _direct_addressing)
+                    {
+                        build_directory();
+
+                        if (filter == MEMBERSHIP_FILTER::BLOOM)
+                            build_filter();
+                    }
+
+                    setup_tails(text);
+                }
+
+                // view the positions shared by all ks after loading
+                void share_positions(std::span<const position_t> positions)
+                {
+                    _positions = flat_array<position_t>(positions);
+                }
+
+                std::span<const position_t> shared_positions() const
+                {
+                    return _positions.view();
+                }
+
+                // number of characters covered by one kmer, more than k with a gapped shape
+                size_t span() const
+                {
+                    return _span;
+                }
+
+                size_t window() const
+                {
+                    return _window;
+                }
+
+                // throws unless shape is 0 or hashes exactly k characters, the last of which is the last of the shape
+                static void check_shape(uint64_t shape)
+                {
+                    if (shape != 0 and (size_t(std::popcount(shape)) != k or (shape & 1) == 0))
+                        throw std::invalid_argument("the shape of k = " + std::to_string(k) + " has to hash exactly k "
+                                                    "characters, the last of which is the last character of the shape");
+                }
+
+                // set _text_size, returns the number of kmers of text
+                // sequences of a collection are separated by one unused position
+                template<std::ranges::range text_t>
+                size_t setup_text_size(text_t& text)
+                {
+                    size_t n_kmers = 0;
+                    _text_size = 0;
+                    for_each_sequence(text, [&](auto& sequence)
+                    {
+                        size_t size = std::ranges::size(sequence);
+                        n_kmers += size >= _span ? size - _span + 1 : 0;
+                        _text_size += size + 1;
+                    });
+
+                    _text_size = _text_size > 0 ? _text_size - 1 : 0;
+
+                    assert(_text_size < std::numeric_limits<position_t>::max() &&
+                        "your text is too large for this configuration");
+
+                    return n_kmers;
+                }
+
+                void build_filter()
+                {
+                    _filter = blocked_bloom_filter(_keys.size());
+                    for (const hash_t& key : _keys)
+                        _filter.insert(filter_key(key));
+                }
+
+                template<std::ranges::range text_t>
+                void setup_tails(text_t& text)
+                {
+                    _tails.clear();
+                    _tail_positions.clear();
+                    _tail_offsets = {0};
+
+                    size_t start = 0;
+                    for_each_sequence(text, [&](auto& sequence)
+                    {
+                        size_t size = std::ranges::size(sequence);
+                        size_t tail_size = std::min(size, k - 1);
+
+                        for (size_t i = size - tail_size; i < size; ++i)
+                        {
+                            _tails.push_back(sequence[i]);
+                            _tail_positions.push_back(start + i);
+                        }
+
+                        _tail_offsets.push_back(_tails.size());
+                        start += size + 1;
+                    });
+                }
+
+                void save(binary_writer& out) const
+                {
+                    out.write_value<uint64_t>(k);
+                    out.write_value<uint64_t>(sizeof(hash_t));
+                    out.write_value<uint8_t>(_direct_addressing);
+                    out.write_value<uint8_t>(_elias_fano);
+                    out.write_value<uint8_t>(_canonical);
+                    out.write_value<uint8_t>(_shared);
+                    out.write_value<uint8_t>(_sorted_buckets);
+                    out.write_value<uint64_t>(_window);
+                    out.write_value<uint64_t>(_shape);
+                    out.write_value<uint64_t>(_text_size);
+                    out.write_value<uint64_t>(_directory_shift);
+
+                    // shared positions are written once by kmer_index
+                    out.write_array(_offsets.view());
+                    out.write_array(_shared ? std::span<const position_t>() : _positions.view());
+                    out.write_array(_keys.view());
+                    out.write_array(_skip_buckets.view());
+                    out.write_array(_skip_counts.view());
+                    out.write_array(_directory.view());
+                    out.write_array(_reverse_keys.view());
+                    out.write_array(_reverse_key_indices.view());
+                    _encoded_positions.save(out);
+                    _filter.save(out);
+
+                    std::vector<uint8_t> tail_ranks;
+                    for (auto c : _tails)
+                        tail_ranks.push_back(seqan3::to_rank(c));
+
+                    std::vector<uint64_t> tail_offsets(_tail_offsets.begin(), _tail_offsets.end());
+
+                    out.write_array(std::span<const uint8_t>(tail_ranks));
+                    out.write_array(std::span<const position_t>(_tail_positions));
+                    out.write_array(std::span<const uint64_t>(tail_offsets));
+                }
+
+                // large arrays stay views into the mapped file
+                void load(binary_reader& in, std::shared_ptr<const mapped_file> file)
+                {
+                    if (in.read_value<uint64_t>() != k)
+                        throw std::invalid_argument("index file does not match the ks of this index");
+
+                    if (in.read_value<uint64_t>() != sizeof(hash_t))
+                        throw std::invalid_argument("index file does not match the hash type of this index");
+
+                    _mapped_file = std::move(file);
+                    _direct_addressing = in.read_value<uint8_t>();
+                    _elias_fano = in.read_value<uint8_t>();
+                    _canonical = in.read_value<uint8_t>();
+                    _shared = in.read_value<uint8_t>();
+                    _sorted_buckets = in.read_value<uint8_t>();
+                    _window = in.read_value<uint64_t>();
+                    setup_shape(in.read_value<uint64_t>());
+                    _text_size = in.read_value<uint64_t>();
+                    _directory_shift = in.read_value<uint64_t>();
+
+                    _offsets = flat_array<position_t>(in.template read_array<position_t>());
+                    _positions = flat_array<position_t>(in.template read_array<position_t>());
+                    _keys = flat_array<hash_t>(in.template read_array<hash_t>());
+                    _skip_buckets = flat_array<uint64_t>(in.template read_array<uint64_t>());
+                    _skip_counts = flat_array<position_t>(in.template read_array<position_t>());
+                    _directory = flat_array<position_t>(in.template read_array<position_t>());
+                    _reverse_keys = flat_array<hash_t>(in.template read_array<hash_t>());
+                    _reverse_key_indices = flat_array<position_t>(in.template read_array<position_t>());
+                    _encoded_positions.load(in);
+                    _filter.load(in);
+
+                    _tails.clear();
+                    for (auto rank : in.template read_array<uint8_t>())
+                        _tails.push_back(alphabet_t{}.assign_rank(rank));
+
+                    auto tail_positions = in.template read_array<position_t>();
+                    _tail_positions.assign(tail_positions.begin(), tail_positions.end());
+
+                    auto tail_offsets = in.template read_array<uint64_t>();
+                    _tail_offsets.assign(tail_offsets.begin(), tail_offsets.end());
+                }
+
+            public:
+                template<typename iterator_t>
+                list_t search_k(iterator_t it) const
+                {
+                    return at(hash(it));
+                }
+
+                // one lookup of kmer_index::search_batch, its hash and key index are computed once and reused by every
+                // prefetch stage and by at(lookup) (c.f. [8] in kmer_index)
+                struct batch_lookup
+                {
+                    hash_t hash;
+
+                    // index in _keys, _keys.size() if the kmer does not occur, _unknown_key before stage 2
+                    size_t key_i;
+
+                    // number of the lookup in its group, set by the caller
+                    size_t n;
+                };
+
+                constexpr static size_t _unknown_key = size_t(-1);
+
+                // hash the kmer at it and prefetch the memory of the first access of its lookup
+                template<typename iterator_t>
+                batch_lookup start_lookup(iterator_t it, size_t n) const
+                {
+                    batch_lookup lookup{canonical(hash(it)), _unknown_key, n};
+                    prefetch(lookup, 0);
+                    return lookup;
+                }
+
+                // prefetch the memory that the given stage of lookup accesses, assumes that the memory of the previous
+                // stages is already cached
+                void prefetch(batch_lookup& lookup, size_t stage) const
+                {
+                    if (_direct_addressing)
+                    {
+                        size_t h = static_cast<size_t>(lookup.hash);
+
+                        if (stage == 0)
+                            __builtin_prefetch(_offsets.data() + h);
+                        else if (stage == 1 and not _elias_fano)
+                            __builtin_prefetch(_positions.data() + _offsets[h]);
+
+                        return;
+                    }
+
+                    if (stage == 0)
+                    {
+                        _filter.prefetch(filter_key(lookup.hash));
+                        __builtin_prefetch(_directory.data() + static_cast<size_t>(lookup.hash >> _directory_shift));
+                    }
+                    else if (stage == 1)
+                    {
+                        // kmers rejected by the filter need no further memory
+                        if (not _filter.may_contain(filter_key(lookup.hash)))
+                            lookup.key_i = _keys.size();
+                        else
+                            __builtin_prefetch(_keys.data() + _directory[static_cast<size_t>(lookup.hash >> _directory_shift)]);
+                    }
+                    else
+                    {
+                        if (lookup.key_i == _unknown_key)
+                            lookup.key_i = find_key(lookup.hash);
+
+                        if (lookup.key_i == _keys.size())
+                            return;
+
+                        if (stage == 2)
+                            __builtin_prefetch(_offsets.data() + lookup.key_i);
+                        else if (not _elias_fano)
+                            __builtin_prefetch(_positions.data() + _offsets[lookup.key_i]);
+                    }
+                }
+
+                // positions of a lookup, only searches the keys if no stage did so yet
+                list_t at(const batch_lookup& lookup) const
+                {
+                    if (_direct_addressing)
+                        return bucket_list(static_cast<size_t>(lookup.hash));
+
+                    if (lookup.key_i != _unknown_key)
+                        return key_list(lookup.key_i);
+
+                    if (not _filter.may_contain(filter_key(lookup.hash)))
+                        return list_t();
+
+                    return key_list(find_key(lookup.hash));
+                }
+
+                // search any query, in canonical mode the hits of m != k are candidates of either strand and with a
+                // window > 1 or a shape those of a query with a full window are candidates of minimizers or spaced
+                // seeds, kmer_index verifies them (c.f. [14], [18], [19])
+                virtual result_t search(std::vector<alphabet_t>& query) const
+                {
+                    assert(query.size() > 0);
+
+                    // only minimizers or spaced seeds are stored
+                    if (is_sampled())
+                    {
+                        std::vector<position_t> candidates;
+                        sampled_candidates(query, candidates);
+                        if (candidates.empty())
+                            return result_t();
+
+                        return result_t(std::move(candidates), true, BYPASS_BITMASK::YES);
+                    }
+
+                    // query size < k with canonical kmers
+                    if (_canonical and query.size() < k)
+                    {
+                        std::vector<position_t> candidates;
+                        canonical_prefix_candidates(query, candidates);
+                        if (candidates.empty())
+                            return result_t();
+
+                        return result_t(std::move(candidates), true, BYPASS_BITMASK::YES);
+                    }
+
+                    // query size exactly k
+                    if (query.size() == k)
+                        return list_result(at(hash(query.begin())));
+                    // query size m > k
+                    else if (query.size() > k)
+                    {
+                        auto candidates = block_candidates(query);
+                        if (candidates.empty())
+                            return result_t();
+
+                        return result_t(std::move(candidates), true, BYPASS_BITMASK::YES);
+                    }
+
+                    // query.size() < k
+                    else
+                    {
+                        auto lists = get_position_for_all_kmer_with_prefix(query.begin(), query.size());
+
+                        bool any_encoded = std::any_of(lists.begin(), lists.end(), [](const list_t& list) { return list.is_encoded(); });
+
+                        if (not any_encoded)
+                        {
+                            std::vector<positions_t> spans;
+                            for (const auto& list : lists)
+                                spans.push_back(list.plain());
+
+                            return result_t(spans);
+                        }
+
+                        // the decoded lists follow one another, so the positions are not ascending
+                        std::vector<position_t> decoded;
+                        for (const auto& list : lists)
+                            list.decode(decoded);
+
+                        return result_t(std::move(decoded), true, BYPASS_BITMASK::YES, SORTED_POSITIONS::NO);
+                    }
+                }
+
+                // search query of size m >= k whose kmers were already looked up by kmer_index::search_batch, lists
+                // holds them in the order of kmer_index::for_each_lookup
+                result_t search(std::vector<alphabet_t>& query, std::span<const list_t> lists) const
+                {
+                    assert(query.size() >= k);
+
+                    if (query.size() == k)
+                        return list_result(lists.front());
+
+                    search_context<position_t> context;
+                    block_candidates(query, context, lists);
+                    if (context.positions.empty())
+                        return result_t();
+
+                    return result_t(std::move(context.positions), true, BYPASS_BITMASK::YES);
+                }
+
+                // result holding the positions of a single list
+                result_t list_result(const list_t& pos) const
+                {
+                    if (pos.empty())
+                        return result_t();
+                    else if (not pos.is_encoded())
+                        return result_t(pos.plain(), true, BYPASS_BITMASK::YES,
+                                        _sorted_buckets ? SORTED_POSITIONS::YES : SORTED_POSITIONS::NO);
+
+                    std::vector<position_t> decoded;
+                    pos.decode(decoded);
+                    return result_t(std::move(decoded), true, BYPASS_BITMASK::YES);
+                }
+
+                // sorted positions of any query, only uses the memory of context (c.f. [16])
+                std::span<const position_t> search_into(std::vector<alphabet_t>& query, search_context<position_t>& context) const
+                {
+                    assert(query.size() > 0);
+
+                    context.positions.clear();
+
+                    if (is_sampled())
+                    {
+                        sampled_candidates(query, context.positions);
+                        return context.positions;
+                    }
+
+                    if (_canonical and query.size() < k)
+                    {
+                        canonical_prefix_candidates(query, context.positions);
+                        return context.positions;
+                    }
+
+                    if (query.size() == k)
+                    {
+                        auto positions = at(hash(query.begin())).plain_or_decode(context.positions);
+                        if (_sorted_buckets)
+                            return positions;
+
+                        context.positions.assign(positions.begin(), positions.end());
+                        std::sort(context.positions.begin(), context.positions.end());
+                        return context.positions;
+                    }
+
+                    if (query.size() > k)
+                    {
+                        block_candidates(query, context);
+                        return context.positions;
+                    }
+
+                    // query.size() < k: one ascending run per kmer with the prefix
+                    context.lists.clear();
+                    get_position_for_all_kmer_with_prefix(query.begin(), query.size(),
+                                                          prefix_hash(query.begin(), query.size()), context.lists);
+
+                    bool any_encoded = std::any_of(context.lists.begin(), context.lists.end(),
+                                                   [](const list_t& list) { return list.is_encoded(); });
+
+                    if (any_encoded)
+                    {
+                        for (const auto& list : context.lists)
+                            list.decode(context.positions);
+
+                        std::sort(context.positions.begin(), context.positions.end());
+                        return context.positions;
+                    }
+
+                    context.runs.clear();
+                    for (const auto& list : context.lists)
+                        context.runs.push_back(list.plain());
+
+                    merge_runs(context.runs, context.positions, context.scratch, context.bounds);
+                    return context.positions;
+                }
+
+                // number of occurrences of any query, positions are only collected if m > k (c.f. [11])
+                size_t count(std::vector<alphabet_t>& query, search_context<position_t>& context) const
+                {
+                    assert(query.size() > 0);
+
+                    if (is_sampled() or (_canonical and query.size() < k))
+                    {
+                        search_into(query, context);
+                        return context.positions.size();
+                    }
+
+                    if (query.size() == k)
+                        return at(hash(query.begin())).size();
+                    else if (query.size() > k)
+                    {
+                        size_t n = 0;
+                        with_block_lookups(query, [&](auto&& window_hash, auto&& block_list)
+                        {
+                            n = block_count(query, context, window_hash, block_list);
+                        });
+
+                        return n;
+                    }
+
+                    // query.size() < k: the buckets of all kmers with the prefix are adjacent
+                    auto [begin, end] = prefix_range(prefix_hash(query.begin(), query.size()), query.size());
+
+                    size_t n = _offsets[end] - _offsets[begin];
+                    for_each_tail_match(query.begin(), query.size(), [&](size_t) { ++n; });
+
+                    auto skipped = std::lower_bound(_skip_buckets.begin(), _skip_buckets.end(), uint64_t(begin));
+                    for (; skipped != _skip_buckets.end() and *skipped < end; ++skipped)
+                        n -= _skip_counts[skipped - _skip_buckets.begin()];
+
+                    return n;
+                }
+        };
+    } // end of namespace detail
+
+    template<seqan3::alphabet alphabet_t, typename position_t, size_t... ks>
+    class kmer_index
+        : public detail::kmer_index_element<alphabet_t, position_t, ks>...
+    {
+        private:
+            template<size_t k>
+            using index_element_t = detail::kmer_index_element<alphabet_t, position_t, k>;
+            using index_t = kmer_index<alphabet_t, position_t, ks...>;
+            using result_t = detail::kmer_index_result<position_t>;
+
+            inline static std::vector<size_t> _all_ks = std::vector<size_t>{ks...};
+
+            // workaround to allow for RVO call of specific element with non-constexpr k (c.f. [1])
+            template<size_t k>
+            result_t call_search(std::vector<alphabet_t>& query) const
+            {
+                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search(query);
+            }
+
+            using search_fn = result_t(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    std::vector<alphabet_t>&) const;
+
+            const std::array<search_fn, sizeof...(ks)> _search_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_search<ks>)...};
+
+            template<size_t k>
+            std::span<const position_t> call_search_into(std::vector<alphabet_t>& query, detail::search_context<position_t>& context) const
+            {
+                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search_into(query, context);
+            }
+
+            using search_into_fn = std::span<const position_t>(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    std::vector<alphabet_t>&, detail::search_context<position_t>&) const;
+
+            const std::array<search_into_fn, sizeof...(ks)> _search_into_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_search_into<ks>)...};
+
+            template<size_t k>
+            size_t call_count(std::vector<alphabet_t>& query, detail::search_context<position_t>& context) const
+            {
+                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::count(query, context);
+            }
+
+            using count_fn = size_t(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    std::vector<alphabet_t>&, detail::search_context<position_t>&) const;
+
+            const std::array<count_fn, sizeof...(ks)> _count_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_count<ks>)...};
+
+            template<size_t k>
+            detail::position_list<position_t> call_search_k(typename std::vector<alphabet_t>::iterator query_begin) const
+            {
+                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search_k(query_begin);
+            }
+
+            using search_k_fn = detail::position_list<position_t>(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    typename std::vector<alphabet_t>::iterator) const;
+
+            const std::array<search_k_fn, sizeof...(ks)> _search_k_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_search_k<ks>)...};
+
+            template<size_t k>
+            result_t call_search_lists(std::vector<alphabet_t>& query,
+                                       std::span<const detail::position_list<position_t>> lists) const
+            {
+                return static_cast<const index_element_t<k>*>(this)->index_element_t<k>::search(query, lists);
+            }
+
+            using search_lists_fn = result_t(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    std::vector<alphabet_t>&, std::span<const detail::position_list<position_t>>) const;
+
+            const std::array<search_lists_fn, sizeof...(ks)> _search_lists_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_search_lists<ks>)...};
+
+            // lookups of one group of search_batch, every kmer is hashed and searched in the keys once (c.f. [8])
+            struct batch_state
+            {
+                // the pending lookups of each element
+                std::tuple<std::vector<typename index_element_t<ks>::batch_lookup>...> lookups;
+
+                // positions of all lookups of the group, in the order they were started
+                std::vector<detail::position_list<position_t>> lists;
+
+                // first list and number of lookups of each query of the group, no lookups if it is searched regularly
+                std::vector<std::pair<size_t, size_t>> query_lists;
+            };
+
+            template<size_t k>
+            void call_start_lookup(batch_state& state, typename std::vector<alphabet_t>::iterator kmer_begin) const
+            {
+                auto& lookups = std::get<std::vector<typename index_element_t<k>::batch_lookup>>(state.lookups);
+                lookups.push_back(static_cast<const index_element_t<k>*>(this)->index_element_t<k>::start_lookup(
+                        kmer_begin, state.lists.size()));
+                state.lists.emplace_back();
+            }
+
+            using start_lookup_fn = void(kmer_index<alphabet_t, position_t, ks...>::*)(
+                    batch_state&, typename std::vector<alphabet_t>::iterator) const;
+
+            const std::array<start_lookup_fn, sizeof...(ks)> _start_lookup_fns = {
+                    (&kmer_index<alphabet_t, position_t, ks...>::call_start_lookup<ks>)...};
+
+            template<size_t k>
+            void prefetch_lookups(batch_state& state, size_t stage) const
+            {
+                for (auto& lookup : std::get<std::vector<typename index_element_t<k>::batch_lookup>>(state.lookups))
+                    static_cast<const index_element_t<k>*>(this)->index_element_t<k>::prefetch(lookup, stage);
+            }
+
+            // move the positions of the lookups of element k into state.lists
+            template<size_t k>
+            void resolve_lookups(batch_state& state) const
+            {
+                auto& lookups = std::get<std::vector<typename index_element_t<k>::batch_lookup>>(state.lookups);
+                for (const auto& lookup : lookups)
+                    state.lists[lookup.n] = static_cast<const index_element_t<k>*>(this)->index_element_t<k>::at(lookup);
+
+                lookups.clear();
+            }
+
+            // start all lookups of query, returns their first list and number
+            std::pair<size_t, size_t> start_lookups(batch_state& state, std::vector<alphabet_t>& query) const
+            {
+                size_t first = state.lists.size();
+                for_each_lookup(query.size(), [&](size_t k, size_t offset)
+                {
+                    (this->*_start_lookup_fns[_k_to_search_fns_i.at(k)])(state, query.begin() + offset);
+                });
+
+                return {first, state.lists.size() - first};
+            }
+
+            std::array<int, std::max({ks...}) + 1> _k_to_search_fns_i;
+
+            void setup_k_to_search_fn()
+            {
+                std::fill(_k_to_search_fns_i.begin(), _k_to_search_fns_i.end(), -1);
+                size_t i = 0;
+                for (size_t k : std::vector<size_t>{ks...})
+                {
+                    _k_to_search_fns_i[k] = i;
+                    ++i;
+                }
+            }
+
+            // positions of each part of the multi search scheme for query and the offsets of the parts,
+            // false if any part does not occur
+            bool search_parts(std::vector<alphabet_t>& query,
+                              std::vector<detail::position_list<position_t>>& nk_positions,
+                              std::vector<size_t>& shifts) const
+            {
+                size_t offset = 0;
+                for (size_t current_k : _optimal_nk_sum[query.size()])
+                {
+                    auto pos = (this->*_search_k_fns[_k_to_search_fns_i.at(current_k)])(query.begin() + offset);
+                    if (pos.empty())
+                        return false;
+
+                    nk_positions.push_back(pos);
+                    shifts.push_back(offset);
+                    offset += current_k;
+                }
+
+                return true;
+            }
+
+            // calculate which query lengths to search with which k
+            size_t _query_size_range = 10000;
+            inline static size_t _max_possible_k = 32;
+
+            std::vector<std::vector<size_t>> _optimal_nk_sum;
+            std::vector<bool> _use_multi_search_scheme;
+
+            void choose_search_scheme()
+            {
+                // TODO: do this at compile time
+                std::sort(_all_ks.begin(), _all_ks.end(), [](size_t a, size_t b) -> bool { return a > b; });
+
+                std::vector<size_t> high_ks;
+                for (size_t i : _all_ks)
+                    if (i >= 9)
+                        high_ks.push_back(i);
+
+                _optimal_nk_sum.assign(_query_size_range, std::vector<size_t>());
+
+                _use_multi_search_scheme.assign(_query_size_range, false);
+
+                // elements storing minimizers or spaced seeds only find queries with a full window of seeds, so a query
+                // is searched with the largest k that finds it with lookups alone, none if it is too short (c.f. [18])
+                if (_sampled)
+                {
+                    for (size_t q = 0; q < _query_size_range; ++q)
+                    {
+                        for (size_t k : _all_ks)
+                        {
+                            if (q >= min_query_size(k))
+                            {
+                                _optimal_nk_sum[q] = {k};
+                                break;
+                            }
+                        }
+                    }
+
+                    return;
+                }
+
+                // shared positions are only ascending in the buckets of the largest k, so the other ks only answer
+                // queries of their own size and the largest k searches all others (c.f. [17])
+                if (_shares_positions)
+                {
+                    for (size_t q = 0; q < _query_size_range; ++q)
+                        _optimal_nk_sum[q] = {std::ranges::find(_all_ks, q) != _all_ks.end() ? q : _max_k};
+
+                    return;
+                }
+
+                for (size_t k : high_ks)
                 {
                     _optimal_nk_sum[k] = {k};
                     _use_multi_search_scheme[k] = true;
                 }
 
-                for (size_t q =_all_ks.front()+1; q < _query_size_range; ++q)
-                {
-                    bool found = false;
-                    for (size_t k : high_ks)
-                    {
-                        if (not _optimal_nk_sum[q - k].empty())
-                        {
-                            _optimal_nk_sum[q] = _optimal_nk_sum[q - k];
-                            _optimal_nk_sum[q].push_back(k);
-                            found = true;
-                            break;
-                        }
-                    }
+                for (size_t q =_all_ks.front()+1; q < _query_size_range; ++q)
+                {
+                    bool found = false;
+                    for (size_t k : high_ks)
+                    {
+                        if (not _optimal_nk_sum[q - k].empty())
+                        {
+                            _optimal_nk_sum[q] = _optimal_nk_sum[q - k];
+                            _optimal_nk_sum[q].push_back(k);
+                            found = true;
+                            break;
+                        }
+                    }
+
+                    if (found)
+                        _use_multi_search_scheme[q] = true;
+                }
+
+                for (size_t q = 0; q < _query_size_range; ++q)
+                {
+                    if (not _optimal_nk_sum[q].empty())
+                        continue;
+
+                    // canonical kmers have no prefix order, use the largest k that fits into the query
+                    if (q < _all_ks.front() and _orientation == ORIENTATION::CANONICAL)
+                    {
+                        size_t optimal_k = _all_ks.back();
+                        for (size_t k : _all_ks)
+                        {
+                            if (k <= q)
+                            {
+                                optimal_k = k;
+                                break;
+                            }
+                        }
+                        _optimal_nk_sum[q] = {optimal_k};
+                    }
+                    else if (q < _all_ks.front())
+                    {
+                        size_t optimal_k = _all_ks.front();
+                        for (size_t k : _all_ks)
+                        {
+                            if (q <= k and (k - q < optimal_k - q))
+                            {
+                                optimal_k = k;
+                                continue;
+                            }
+                        }
+                        _optimal_nk_sum[q] = {optimal_k};
+                    }
+                    else
+                    {
+                        size_t optimal_k = _all_ks.front();
+                        for (size_t k : _all_ks)
+                        {
+                            if ((ceil(q / float(k)) * k - q) <
+                                (ceil(q / float(optimal_k)) * optimal_k - q))
+                                optimal_k = k;
+                        }
+
+                        _optimal_nk_sum[q] = {optimal_k};
+                    }
+                }
+            }
+
+            // call f(k, offset) for each lookup of a part of size k at offset that search does for a query of
+            // given size, lookups of prefixes shorter than k are skipped
+            template<typename function_t>
+            void for_each_lookup(size_t query_size, function_t&& f) const
+            {
+                const auto& nk_sum = _optimal_nk_sum.at(query_size);
+
+                if (_use_multi_search_scheme[query_size] and _all_ks.size() > 1)
+                {
+                    size_t offset = 0;
+                    for (size_t k : nk_sum)
+                    {
+                        f(k, offset);
+                        offset += k;
+                    }
+                }
+                else
+                {
+                    size_t k = nk_sum.at(0);
+                    for (size_t offset = 0; offset + k <= query_size; offset += k)
+                        f(k, offset);
+
+                    // canonical kmers cover the rest by a last block overlapping the previous one (c.f. block_candidates)
+                    if (_orientation == ORIENTATION::CANONICAL and query_size > k and query_size % k != 0)
+                        f(k, query_size - k);
+                }
+            }
+
+            // can search_batch resolve a query of this size from the lookups of for_each_lookup alone, otherwise
+            // it is searched regularly, which also throws for invalid sizes
+            bool is_batched(size_t query_size) const
+            {
+                if (query_size == 0 or query_size >= _query_size_range)
+                    return false;
+
+                if (_sampled and (_optimal_nk_sum[query_size].empty() or is_sampled(_optimal_nk_sum[query_size][0])))
+                    return false;
+
+                if (_use_multi_search_scheme[query_size] and _all_ks.size() > 1)
+                    return true;
+
+                return query_size >= _optimal_nk_sum.at(query_size).at(0);
+            }
+
+            // number of queries whose lookups are interleaved by search_batch
+            constexpr static size_t _prefetch_group_size = 16;
+
+            // number of consecutive queries a thread of search_parallel claims at once (c.f. [15])
+            constexpr static size_t _parallel_chunk_size = 256;
+
+            // worker threads kept alive between calls of search_parallel (c.f. [15])
+            // copies of an index share them, the mutex only guards replacing the pool by a larger one
+            struct pool_state
+            {
+                std::mutex mutex;
+                std::shared_ptr<detail::thread_pool> pool;
+                size_t n_threads = 0;
+            };
+
+            std::shared_ptr<pool_state> _pool_state = std::make_shared<pool_state>();
+
+            // pool with at least n_threads threads, created by the first call of search_parallel that needs one and
+            // replaced only if more threads are requested
+            // the caller holds a reference, so a pool still running tasks outlives being replaced
+            std::shared_ptr<detail::thread_pool> get_pool(size_t n_threads) const
+            {
+                std::lock_guard<std::mutex> lock(_pool_state->mutex);
+
+                if (not _pool_state->pool or _pool_state->n_threads < n_threads)
+                {
+                    _pool_state->pool = std::make_shared<detail::thread_pool>(n_threads);
+                    _pool_state->n_threads = n_threads;
+                }
+
+                return _pool_state->pool;
+            }
+
+            // _sequence_starts[i] is the global position of the first character of sequence i (c.f. [5])
+            detail::flat_array<position_t> _sequence_starts;
+
+            template<std::ranges::range text_t>
+            void setup_sequence_starts(text_t& text)
+            {
+                std::vector<position_t> starts;
+                size_t start = 0;
+                detail::for_each_sequence(text, [&](auto& sequence)
+                {
+                    starts.push_back(start);
+                    start += std::ranges::size(sequence) + 1;
+                });
+
+                _sequence_starts = detail::flat_array<position_t>(std::move(starts));
+            }
+
+            // characters of the text in global coordinates, used to verify approximate and canonical matches (c.f. [13])
+            // sequences of a collection are separated by one character of rank 0, empty unless _keep_text
+            detail::packed_text<alphabet_t> _text;
+            bool _keep_text = false;
+
+            template<std::ranges::range text_t>
+            void setup_text(text_t& text)
+            {
+                _text = detail::packed_text<alphabet_t>();
+
+                bool first = true;
+                detail::for_each_sequence(text, [&](auto& sequence)
+                {
+                    if (not first)
+                        _text.push_back(alphabet_t{});
+
+                    for (auto c : sequence)
+                        _text.push_back(c);
+
+                    first = false;
+                });
+            }
+
+            // global position one past the last character of sequence i
+            size_t sequence_end(size_t i) const
+            {
+                return i + 1 < _sequence_starts.size() ? _sequence_starts[i + 1] - 1 : _text.size();
+            }
+
+            // does [pos, pos + size) lie inside one sequence
+            bool inside_one_sequence(size_t pos, size_t size) const
+            {
+                auto next_start = std::upper_bound(_sequence_starts.begin(), _sequence_starts.end(), pos);
+                return next_start == _sequence_starts.end() or pos + size < *next_start;
+            }
+
+            // whether the elements store canonical kmers, search then reports hits on both strands (c.f. [14])
+            ORIENTATION _orientation = ORIENTATION::FORWARD;
+
+            // is query searched with a single lookup of a kmer of its size, which finds both strands at once
+            bool is_single_lookup(size_t query_size) const
+            {
+                const auto& nk_sum = _optimal_nk_sum.at(query_size);
+                return nk_sum.size() == 1 and nk_sum.front() == query_size;
+            }
+
+            // reverse complement of query
+            static std::vector<alphabet_t> reverse_complement(const std::vector<alphabet_t>& query)
+            {
+                std::vector<alphabet_t> output;
+                output.reserve(query.size());
+
+                if constexpr (seqan3::nucleotide_alphabet<alphabet_t>)
+                    for (auto it = query.rbegin(); it != query.rend(); ++it)
+                        output.push_back(seqan3::complement(*it));
+
+                return output;
+            }
+
+            // search query with the search scheme of its size, in canonical mode the results are candidates of
+            // either strand unless query is searched with a single lookup
+            result_t search_scheme(std::vector<alphabet_t>& query) const
+            {
+                if (query.size() >= _query_size_range)
+                    throw(std::invalid_argument("query size exceed the maximum size "
+                        + std::to_string(_query_size_range) + " specified"));
+
+                // if rest present just use regular searching
+                if (not _use_multi_search_scheme[query.size()] or _all_ks.size() == 1)
+                {
+                    auto output = (this->*(_search_fns[_k_to_search_fns_i.at(_optimal_nk_sum.at(query.size()).at(0))]))(query);
+                    output.set_sequence_starts(_sequence_starts.view());
+                    return output;
+                }
+
+                // split query into kmers with different k and search each part with appropriate index element
+                std::vector<detail::position_list<position_t>> nk_positions;
+                std::vector<size_t> shifts;
+                if (not search_parts(query, nk_positions, shifts))
+                    return result_t();
+
+                return intersect_parts(nk_positions, shifts);
+            }
+
+            // search_scheme for a query whose lookups were done by search_batch, lists holds their positions in
+            // the order of for_each_lookup
+            result_t search_scheme(std::vector<alphabet_t>& query, std::span<const detail::position_list<position_t>> lists) const
+            {
+                if (not _use_multi_search_scheme[query.size()] or _all_ks.size() == 1)
+                {
+                    auto output = (this->*(_search_lists_fns[_k_to_search_fns_i.at(_optimal_nk_sum.at(query.size()).at(0))]))(query, lists);
+                    output.set_sequence_starts(_sequence_starts.view());
+                    return output;
+                }
+
+                if (std::any_of(lists.begin(), lists.end(), [](const auto& list) { return list.empty(); }))
+                    return result_t();
+
+                std::vector<detail::position_list<position_t>> nk_positions(lists.begin(), lists.end());
+                std::vector<size_t> shifts;
+                for_each_lookup(query.size(), [&](size_t, size_t offset) { shifts.push_back(offset); });
+
+                return intersect_parts(nk_positions, shifts);
+            }
+
+            // positions of a query split into the parts nk_positions at the given shifts
+            result_t intersect_parts(std::vector<detail::position_list<position_t>>& nk_positions,
+                                     std::vector<size_t>& shifts) const
+            {
+                if (nk_positions.size() == 1)
+                {
+                    std::vector<position_t> decoded;
+                    auto first = nk_positions.front().plain_or_decode(decoded);
+
+                    result_t output = decoded.empty() ? result_t(first, true, detail::BYPASS_BITMASK::YES)
+                                                      : result_t(std::move(decoded), true, detail::BYPASS_BITMASK::YES);
+                    output.set_sequence_starts(_sequence_starts.view());
+                    return output;
+                }
+
+                // intersect the parts starting from the smallest list (c.f. intersection.hpp [1])
+                auto candidates = detail::intersect(nk_positions, shifts);
+                if (candidates.empty())
+                    return result_t();
+
+                result_t output(std::move(candidates), true, detail::BYPASS_BITMASK::YES);
+                output.set_sequence_starts(_sequence_starts.view());
+                return output;
+            }
+
+            // does the text at pos match the reverse complement of query
+            bool matches_reverse_complement(size_t pos, const std::vector<alphabet_t>& query) const
+            {
+                if constexpr (seqan3::nucleotide_alphabet<alphabet_t>)
+                {
+                    auto reverse = query | std::views::reverse
+                                         | std::views::transform([](alphabet_t c) { return seqan3::complement(c); });
+                    return _text.matches(pos, reverse.begin(), query.size());
+                }
+                else
+                    return false;
+            }
+
+            // positions of query and its reverse complement in the canonical elements, written to context.positions
+            // (c.f. [14])
+            void search_both_strands(std::vector<alphabet_t>& query, detail::search_context<position_t>& context) const
+            {
+                if (query.size() >= _query_size_range)
+                    throw(std::invalid_argument("query size exceed the maximum size "
+                        + std::to_string(_query_size_range) + " specified"));
+
+                size_t k = _optimal_nk_sum.at(query.size()).at(0);
+
+                if (query.size() < k)
+                {
+                    // candidates of kmers starting with query or ending with its reverse complement, plus the
+                    // positions near the ends of sequences that no such kmer covers
+                    (this->*(_search_into_fns[_k_to_search_fns_i.at(k)]))(query, context);
+                    append_sequence_ends(query.size(), k, context.positions);
+
+                    std::sort(context.positions.begin(), context.positions.end());
+                    context.positions.erase(std::unique(context.positions.begin(), context.positions.end()),
+                                            context.positions.end());
+
+                    std::erase_if(context.positions, [&](position_t pos)
+                    {
+                        return not inside_one_sequence(pos, query.size())
+                               or not (_text.matches(pos, query.begin(), query.size())
+                                       or matches_reverse_complement(pos, query));
+                    });
+                    return;
+                }
+
+                // every kmer is looked up once, its canonical list holds both strands
+                context.lists.clear();
+                for_each_lookup(query.size(), [&](size_t k, size_t offset)
+                {
+                    context.lists.push_back((this->*_search_k_fns[_k_to_search_fns_i.at(k)])(query.begin() + offset));
+                });
+
+                resolve_strands(query, context);
+            }
+
+            // split the candidates of the canonical lists in context.lists, in the order of for_each_lookup, into
+            // those of query and of its reverse complement and verify each against its strand
+            void resolve_strands(std::vector<alphabet_t>& query, detail::search_context<position_t>& context) const
+            {
+                context.positions.clear();
+                if (std::any_of(context.lists.begin(), context.lists.end(), [](const auto& list) { return list.empty(); }))
+                    return;
+
+                // the part at offset of query is found at offset of the query and, as reverse complement, at
+                // query.size() - offset - k of the reverse complement of the query
+                context.shifts.clear();
+                context.reverse_shifts.clear();
+                for_each_lookup(query.size(), [&](size_t k, size_t offset)
+                {
+                    context.shifts.push_back(offset);
+                    context.reverse_shifts.push_back(query.size() - offset - k);
+                });
+
+                detail::intersect(context.lists, context.shifts, context.scratch, context.intersection);
+                std::erase_if(context.scratch, [&](position_t pos)
+                {
+                    return not _text.matches(pos, query.begin(), query.size());
+                });
+
+                detail::intersect(context.lists, context.reverse_shifts, context.reverse_positions, context.intersection);
+                std::erase_if(context.reverse_positions, [&](position_t pos)
+                {
+                    return not matches_reverse_complement(pos, query);
+                });
+
+                // palindromic queries are found on both strands at the same position
+                context.positions.resize(context.scratch.size() + context.reverse_positions.size());
+                auto end = std::set_union(context.scratch.begin(), context.scratch.end(),
+                                          context.reverse_positions.begin(), context.reverse_positions.end(),
+                                          context.positions.begin());
+                context.positions.erase(end, context.positions.end());
+            }
+
+            // append the positions in the first k - size and the last k - 1 characters of each sequence, there
+            // canonical kmers do not cover a query of given size on both strands
+            void append_sequence_ends(size_t size, size_t k, std::vector<position_t>& output) const
+            {
+                for (size_t i = 0; i < _sequence_starts.size(); ++i)
+                {
+                    size_t start = _sequence_starts[i];
+                    size_t end = sequence_end(i);
+
+                    for (size_t pos = start; pos < std::min(start + k - size, end); ++pos)
+                        output.push_back(pos);
+
+                    for (size_t pos = std::max(start + k - size, end >= k ? end - k + 1 : 0); pos < end; ++pos)
+                        output.push_back(pos);
+                }
+            }
+
+            // result holding the positions of context
+            result_t make_result(detail::search_context<position_t>& context) const
+            {
+                if (context.positions.empty())
+                    return result_t();
+
+                result_t output(std::move(context.positions), true, detail::BYPASS_BITMASK::YES);
+                output.set_sequence_starts(_sequence_starts.view());
+                return output;
+            }
+
+            // verified positions of query with at most max_errors substitutions, appended to output (c.f. [13])
+            void append_approximate(std::vector<alphabet_t>& query, size_t max_errors, std::vector<position_t>& output) const
+            {
+                // by the pigeonhole principle at least one of max_errors + 1 disjoint parts occurs without error, each
+                // part is the largest k that fits into its slice of the query so that it is a single lookup
+                size_t n_parts = max_errors + 1;
+                size_t slice_size = query.size() / n_parts;
+
+                // sampled elements need parts with a full window of seeds
+                size_t part_size = 0, part_k = 0;
+                for (size_t k : _all_ks)
+                {
+                    size_t size = std::max(k, min_query_size(k));
+                    if (size <= slice_size and k > part_k)
+                    {
+                        part_k = k;
+                        part_size = size;
+                    }
+                }
+
+                if (part_size == 0)
+                    part_size = slice_size;
+
+                search_context context;
+                std::vector<alphabet_t> part;
+                std::vector<position_t> candidates;
+
+                for (size_t i = 0; i < n_parts; ++i)
+                {
+                    size_t offset = i * slice_size;
+                    part.assign(query.begin() + offset, query.begin() + offset + part_size);
+
+                    // in canonical mode part is found on both strands, which the verification below tells apart
+                    for (position_t pos : search(part, context))
+                        if (pos >= offset and pos - offset + query.size() <= _text.size())
+                            candidates.push_back(pos - offset);
+                }
+
+                std::sort(candidates.begin(), candidates.end());
+                candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+                // verify each candidate once against the packed text
+                for (position_t candidate : candidates)
+                    if (inside_one_sequence(candidate, query.size())
+                        and _text.mismatches(candidate, query.begin(), query.size(), max_errors) <= max_errors)
+                        output.push_back(candidate);
+            }
+
+            // file format version, increment on every change to save()
+            constexpr static uint32_t _file_version = 11;
+            constexpr static uint32_t _byte_order_mark = 0x01020304;
+            constexpr static char _file_magic[8] = "KMERIDX";
+
+            // CTOR used by load, elements are filled afterwards
+            kmer_index()
+                    : index_element_t<ks>()...
+            {}
+
+            template<std::ranges::range text_t>
+            void create(text_t& text, size_t n_threads, const kmer_index_options& options)
+            {
+                const auto& shapes = options.shapes;
+
+                if (not shapes.empty() and shapes.size() != sizeof...(ks))
+                    throw std::invalid_argument("either no shape or one shape per k has to be specified");
+
+                // a shape is gapped if its set bits are not consecutive
+                _window = std::max<size_t>(options.minimizer_window, 1);
+                _sampled = _window > 1 or std::ranges::any_of(shapes, [](uint64_t shape) {
+                    return size_t(std::popcount(shape)) != size_t(std::bit_width(shape));
+                });
+
+                if (_sampled and (options.orientation == ORIENTATION::CANONICAL
+                                  or options.encoding == POSITION_ENCODING::SHARED))
+                    throw std::invalid_argument("minimizers and spaced seeds can only be stored for forward kmers, "
+                                                "and not with shared positions");
+
+                if (_window > 1 and sizeof...(ks) == 1)
+                    throw std::invalid_argument("minimizers need at least two ks, the smallest k stores all of its kmers");
+
+                // the smallest k stores all kmers, so queries without a full window are still looked up (c.f. [18])
+                auto window_of = [&](size_t k) -> size_t { return k == _min_k ? 1 : _window; };
+
+                _keep_text = options.approximate == APPROXIMATE_SEARCH::ENABLED
+                             or options.orientation == ORIENTATION::CANONICAL or _sampled;
+
+                // shape of element k, in the order of ks
+                auto shape_of = [&](size_t k) -> uint64_t
+                {
+                    constexpr std::array<size_t, sizeof...(ks)> all_ks = {ks...};
+                    return shapes.empty() ? 0 : shapes[std::ranges::find(all_ks, k) - all_ks.begin()];
+                };
+
+                // before any element is constructed
+                (this->index_element_t<ks>::check_shape(shape_of(ks)), ...);
+
+                // the threads are only needed during construction, so they are joined when it is done
+                detail::thread_pool pool(n_threads);
+
+                size_t n_kmers = 0;
+                detail::for_each_sequence(text, [&](auto& sequence)
+                {
+                    size_t size = std::ranges::size(sequence);
+                    n_kmers += size >= std::min({ks...}) ? size - std::min({ks...}) + 1 : 0;
+                });
+
+                _shares_positions = options.encoding == POSITION_ENCODING::SHARED;
+
+                if (_shares_positions)
+                {
+                    if (options.orientation == ORIENTATION::CANONICAL)
+                        throw std::invalid_argument("shared positions need the prefix order of forward kmers, "
+                                                    "which canonical kmers do not have");
+
+                    create_shared(text, options.filter, pool, n_threads);
+                }
+                // elements of texts too short to be split into chunks are constructed concurrently, one task each,
+                // otherwise one after another, each of them using all threads (c.f. [6])
+                else if (n_threads > 1 and sizeof...(ks) > 1 and n_kmers < 2 * detail::_min_chunk_size)
+                {
+                    detail::parallel_for(pool, sizeof...(ks), [&](size_t i)
+                    {
+                        size_t element_i = 0;
+                        ((element_i++ == i ? this->index_element_t<ks>::create(text, options.encoding, options.filter,
+                                                                               options.orientation, window_of(ks),
+                                                                               shape_of(ks), pool, 1)
+                                           : void()), ...);
+                    });
+                }
+                else
+                    (this->index_element_t<ks>::create(text, options.encoding, options.filter, options.orientation,
+                                                       window_of(ks), shape_of(ks), pool, n_threads), ...);
+
+                _orientation = options.orientation;
+                setup_sequence_starts(text);
+                setup_k_to_search_fn();
+                choose_search_scheme();
+            }
+
+            // with a window w > 1 the elements only store the minimizers of every w consecutive kmers (c.f. [18])
+            size_t _window = 1;
+
+            // the elements only store minimizers or spaced seeds, whose candidates are verified against _text (c.f. [19])
+            bool _sampled = false;
+
+            // number of characters covered by a kmer of element k, more than k if its shape is gapped (c.f. [19])
+            size_t span(size_t k) const
+            {
+                size_t out = k;
+                ((ks == k ? void(out = this->index_element_t<ks>::span()) : void()), ...);
+                return out;
+            }
+
+            constexpr static size_t _min_k = std::min({ks...});
+
+            // does element k only store minimizers or spaced seeds, whose candidates are verified (c.f. [18], [19])
+            bool is_sampled(size_t k) const
+            {
+                size_t window = 1;
+                ((ks == k ? void(window = this->index_element_t<ks>::window()) : void()), ...);
+                return window > 1 or span(k) > k;
+            }
+
+            // smallest query that element k finds with lookups alone, sampled elements need a full window of seeds
+            size_t min_query_size(size_t k) const
+            {
+                size_t window = 1;
+                ((ks == k ? void(window = this->index_element_t<ks>::window()) : void()), ...);
+                return is_sampled(k) ? window + span(k) - 1 : 1;
+            }
+
+            // k a query of the given size is searched with
+            size_t scheme_k(size_t query_size) const
+            {
+                if (query_size >= _query_size_range)
+                    throw(std::invalid_argument("query size exceed the maximum size "
+                        + std::to_string(_query_size_range) + " specified"));
+
+                if (_optimal_nk_sum[query_size].empty())
+                {
+                    size_t min_size = query_size + 1;
+                    for (size_t k : _all_ks)
+                        min_size = std::min(min_size, min_query_size(k));
+
+                    throw std::invalid_argument("query size has to be at least " + std::to_string(min_size)
+                                                + " to be covered by the stored seeds");
+                }
+
+                return _optimal_nk_sum[query_size].front();
+            }
+
+            // does query occur at the candidate pos
+            bool verify(position_t pos, std::vector<alphabet_t>& query) const
+            {
+                return inside_one_sequence(pos, query.size()) and _text.matches(pos, query.begin(), query.size());
+            }
+
+            // whether the elements share one array of positions, which is only ascending in the buckets of the
+            // largest k (c.f. [17])
+            bool _shares_positions = false;
+            constexpr static size_t _max_k = std::max({ks...});
+
+            // sort all positions of text by the kmer of the largest k starting at them, each element then only
+            // builds its offsets into them (c.f. [17])
+            template<std::ranges::range text_t>
+            void create_shared(text_t& text, MEMBERSHIP_FILTER filter, detail::thread_pool& pool, size_t n_threads)
+            {
+                constexpr size_t sigma = seqan3::alphabet_size<alphabet_t>;
+
+                if constexpr (not std::is_same_v<detail::minimal_hash_t<sigma, _max_k>, uint64_t>)
+                    throw std::invalid_argument("shared positions need hashes of the largest k that fit into 64 bit");
+                else
+                {
+                    size_t text_size = 0;
+                    detail::for_each_sequence(text, [&](auto& sequence) { text_size += std::ranges::size(sequence) + 1; });
+
+                    // hash of the kmer of size _max_k at each position with rank 0 past the end of its sequence, and
+                    // the number of characters left in the sequence, capped at _max_k
+                    std::vector<uint64_t> hashes(text_size);
+                    std::vector<uint8_t> rests(text_size);
+                    std::vector<position_t> positions;
+                    positions.reserve(text_size);
+
+                    const uint64_t highest = detail::fast_pow(sigma, _max_k - 1);
+
+                    size_t start = 0;
+                    detail::for_each_sequence(text, [&](auto& sequence)
+                    {
+                        size_t size = std::ranges::size(sequence);
+                        auto rank_at = [&](size_t i) -> uint64_t { return i < size ? seqan3::to_rank(sequence[i]) : 0; };
+
+                        uint64_t h = 0;
+                        for (size_t i = 0; i < _max_k; ++i)
+                            h = h * sigma + rank_at(i);
+
+                        for (size_t i = 0; i < size; ++i)
+                        {
+                            hashes[start + i] = h;
+                            rests[start + i] = std::min(size - i, _max_k);
+                            positions.push_back(start + i);
+                            h = (h - rank_at(i) * highest) * sigma + rank_at(i + _max_k);
+                        }
+
+                        start += size + 1;
+                    });
+
+                    // positions with fewer characters left come first among equal hashes
+                    auto less = [&](position_t a, position_t b) -> bool
+                    {
+                        if (hashes[a] != hashes[b])
+                            return hashes[a] < hashes[b];
+
+                        if (rests[a] != rests[b])
+                            return rests[a] < rests[b];
+
+                        return a < b;
+                    };
+
+                    // sort chunks in parallel, then merge pairs of them pass by pass
+                    size_t n_chunks = std::clamp<size_t>(positions.size() / detail::_min_chunk_size, 1, n_threads);
+                    auto bound = [&](size_t chunk) { return positions.begin() + chunk * positions.size() / n_chunks; };
+
+                    detail::parallel_for(pool, n_chunks, [&](size_t chunk)
+                    {
+                        std::sort(bound(chunk), bound(chunk + 1), less);
+                    });
+
+                    for (size_t width = 1; width < n_chunks; width *= 2)
+                    {
+                        detail::parallel_for(pool, (n_chunks + 2 * width - 1) / (2 * width), [&](size_t pair)
+                        {
+                            size_t first = pair * 2 * width;
+                            if (first + width < n_chunks)
+                                std::inplace_merge(bound(first), bound(first + width),
+                                                   bound(std::min(first + 2 * width, n_chunks)), less);
+                        });
+                    }
+
+                    std::vector<uint64_t> sorted_hashes(positions.size());
+                    std::vector<uint8_t> sorted_rests(positions.size());
+                    for (size_t i = 0; i < positions.size(); ++i)
+                    {
+                        sorted_hashes[i] = hashes[positions[i]];
+                        sorted_rests[i] = rests[positions[i]];
+                    }
+
+                    hashes = std::vector<uint64_t>();
+                    rests = std::vector<uint8_t>();
+
+                    auto shared = std::make_shared<const std::vector<position_t>>(std::move(positions));
+
+                    // the elements only read the shared arrays, so they are constructed concurrently
+                    detail::parallel_for(pool, sizeof...(ks), [&](size_t i)
+                    {
+                        size_t element_i = 0;
+                        ((element_i++ == i ? this->index_element_t<ks>::create_shared(text, shared, sorted_hashes,
+                                                                                     sorted_rests, _max_k, filter)
+                                           : void()), ...);
+                    });
+                }
+            }
+
+            // construct from the sequences of the packed _text, each followed by one separator
+            void create_from_sequences(const std::vector<size_t>& sequence_sizes, size_t n_threads,
+                                       const kmer_index_options& options)
+            {
+                std::vector<std::ranges::subrange<typename detail::packed_text<alphabet_t>::iterator>> sequences;
+
+                size_t start = 0;
+                for (size_t size : sequence_sizes)
+                {
+                    sequences.emplace_back(_text.begin() + start, _text.begin() + start + size);
+                    start += size + 1;
+                }
+
+                assert(start == _text.size() + 1 && "sequence sizes do not match the text");
+
+                create(sequences, n_threads, options);
+            }
+
+        public:
+            // CTOR
+            template<std::ranges::range text_t>
+            kmer_index(text_t& text,
+                       size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u),
+                       const kmer_index_options& options = {})
+                    : index_element_t<ks>()...
+            {
+                create(text, n_threads, options);
+
+                if (_keep_text)
+                    setup_text(text);
+            }
+
+            // CTOR for a text that is packed already, as built by kmer_index_builder, it becomes the text of the index
+            // sequence_sizes are the sizes of the sequences of a collection, which are separated by one character
+            kmer_index(detail::packed_text<alphabet_t>&& text,
+                       const std::vector<size_t>& sequence_sizes,
+                       size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u),
+                       const kmer_index_options& options = {})
+                    : index_element_t<ks>()...
+            {
+                // iterators of a packed text point to it, so the sequences are only cut out after it has been moved
+                _text = std::move(text);
+
+                if (sequence_sizes.size() <= 1)
+                    create(_text, n_threads, options);
+                else
+                    create_from_sequences(sequence_sizes, n_threads, options);
+
+                // the elements do not reference the text once constructed
+                if (not _keep_text)
+                    _text = detail::packed_text<alphabet_t>();
+            }
+
+
+            // number of sequences in the indexed text, 1 if it is not a collection
+            size_t n_sequences() const
+            {
+                return _sequence_starts.size();
+            }
+
+            void extend_query_size_range(size_t new_maximum)
+            {
+                _query_size_range = new_maximum;
+                choose_search_scheme();
+            }
+
+            // write index to binary file (c.f. [3])
+            void save(const std::string& path) const
+            {
+                auto out = detail::binary_writer(path);
+
+                for (char c : _file_magic)
+                    out.write_value<char>(c);
+
+                out.write_value<uint32_t>(_file_version);
+                out.write_value<uint32_t>(_byte_order_mark);
+                out.write_value<uint32_t>(seqan3::alphabet_size<alphabet_t>);
+                out.write_value<uint32_t>(sizeof(position_t));
+
+                auto all_ks = std::vector<uint64_t>{ks...};
+                out.write_array(std::span<const uint64_t>(all_ks));
+                out.write_value<uint8_t>(bool(_orientation));
+                out.write_array(_sequence_starts.view());
+                out.write_value<uint8_t>(_keep_text);
+                _text.save(out);
+
+                out.write_value<uint64_t>(_window);
+                out.write_value<uint8_t>(_sampled);
+                out.write_value<uint8_t>(_shares_positions);
+                out.write_array(_shares_positions ? this->index_element_t<_max_k>::shared_positions()
+                                                  : std::span<const position_t>());
+
+                (this->index_element_t<ks>::save(out), ...);
+
+                // search scheme
+                out.write_value<uint64_t>(_query_size_range);
+
+                std::vector<uint8_t> use_multi_search_scheme(_use_multi_search_scheme.begin(), _use_multi_search_scheme.end());
+                out.write_array(std::span<const uint8_t>(use_multi_search_scheme));
+
+                std::vector<uint64_t> nk_sum_offsets = {0}, nk_sums;
+                for (const auto& nk_sum : _optimal_nk_sum)
+                {
+                    nk_sums.insert(nk_sums.end(), nk_sum.begin(), nk_sum.end());
+                    nk_sum_offsets.push_back(nk_sums.size());
+                }
+
+                out.write_array(std::span<const uint64_t>(nk_sum_offsets));
+                out.write_array(std::span<const uint64_t>(nk_sums));
+
+                out.finish();
+            }
+
+            // memory map index file written by save(), search then runs directly on the mapped pages
+            static kmer_index load(const std::string& path)
+            {
+                auto file = std::make_shared<const detail::mapped_file>(path);
+                auto in = detail::binary_reader(file);
+
+                for (char c : _file_magic)
+                    if (in.read_value<char>() != c)
+                        throw std::invalid_argument(path + " is not a kmer index file");
+
+                if (in.read_value<uint32_t>() != _file_version)
+                    throw std::invalid_argument(path + " was written by an incompatible version");
+
+                if (in.read_value<uint32_t>() != _byte_order_mark)
+                    throw std::invalid_argument(path + " was written on a machine with different byte order");
+
+                if (in.read_value<uint32_t>() != seqan3::alphabet_size<alphabet_t> or
+                    in.read_value<uint32_t>() != sizeof(position_t))
+                    throw std::invalid_argument(path + " does not match the alphabet or position type of this index");
+
+                auto all_ks = in.read_array<uint64_t>();
+                if (not std::ranges::equal(all_ks, std::vector<uint64_t>{ks...}))
+                    throw std::invalid_argument(path + " does not match the ks of this index");
+
+                kmer_index output;
+                output._orientation = ORIENTATION(in.read_value<uint8_t>());
+                output._sequence_starts = detail::flat_array<position_t>(in.read_array<position_t>());
+                output._keep_text = in.read_value<uint8_t>();
+                output._text.load(in);
+
+                output._window = in.read_value<uint64_t>();
+                output._sampled = in.read_value<uint8_t>();
+                output._shares_positions = in.read_value<uint8_t>();
+                auto shared_positions = in.read_array<position_t>();
+
+                (output.index_element_t<ks>::load(in, file), ...);
+
+                if (output._shares_positions)
+                    (output.index_element_t<ks>::share_positions(shared_positions), ...);
+
+                // search scheme
+                output._query_size_range = in.read_value<uint64_t>();
+
+                auto use_multi_search_scheme = in.read_array<uint8_t>();
+                output._use_multi_search_scheme.assign(use_multi_search_scheme.begin(), use_multi_search_scheme.end());
+
+                auto nk_sum_offsets = in.read_array<uint64_t>();
+                auto nk_sums = in.read_array<uint64_t>();
+
+                output._optimal_nk_sum.clear();
+                for (size_t q = 0; q + 1 < nk_sum_offsets.size(); ++q)
+                    output._optimal_nk_sum.emplace_back(nk_sums.begin() + nk_sum_offsets[q],
+                                                        nk_sums.begin() + nk_sum_offsets[q + 1]);
+
+                output.setup_k_to_search_fn();
+                return output;
+            }
+
+            // search any query, in canonical mode hits of the reverse complement are reported as well
+            result_t search(std::vector<alphabet_t>& query) const
+            {
+                if (_orientation == ORIENTATION::CANONICAL and not is_single_lookup(query.size()))
+                {
+                    search_context context;
+                    search_both_strands(query, context);
+                    return make_result(context);
+                }
+
+                if (_sampled and is_sampled(scheme_k(query.size())))
+                {
+                    search_context context;
+                    (this->*(_search_into_fns[_k_to_search_fns_i.at(scheme_k(query.size()))]))(query, context);
+
+                    // candidates that do not match are marked in the bitmask instead of being removed
+                    std::vector<size_t> rejected;
+                    for (size_t i = 0; i < context.positions.size(); ++i)
+                        if (not verify(context.positions[i], query))
+                            rejected.push_back(i);
+
+                    if (rejected.size() == context.positions.size())
+                        return result_t();
+
+                    result_t output(std::move(context.positions), true, detail::BYPASS_BITMASK::NO);
+                    for (size_t i : rejected)
+                        output.should_not_use(i);
+
+                    output.set_sequence_starts(_sequence_starts.view());
+                    return output;
+                }
+
+                return search_scheme(query);
+            }
 
-                    if (found)
-                        _use_multi_search_scheme[q] = true;
+            // overload for rvalue
+            result_t search(std::vector<alphabet_t>&& query) const
+            {
+                auto hold = query;
+                return search(hold);
+            }
+
+            // memory that search(query, context) reuses across queries
+            using search_context = detail::search_context<position_t>;
+
+            // sorted global positions of query without allocating once context has grown large enough, the
+            // positions are valid until context is used again (c.f. [16])
+            std::span<const position_t> search(std::vector<alphabet_t>& query, search_context& context) const
+            {
+                if (query.size() >= _query_size_range)
+                    throw(std::invalid_argument("query size exceed the maximum size "
+                        + std::to_string(_query_size_range) + " specified"));
+
+                // both strands are only found by one lookup if query has size k
+                if (_orientation == ORIENTATION::CANONICAL and not is_single_lookup(query.size()))
+                {
+                    search_both_strands(query, context);
+                    return context.positions;
                 }
 
-                for (size_t q = 0; q < _query_size_range; ++q)
+                if (_sampled and is_sampled(scheme_k(query.size())))
                 {
-                    if (not _optimal_nk_sum[q].empty())
-                        continue;
+                    (this->*(_search_into_fns[_k_to_search_fns_i.at(scheme_k(query.size()))]))(query, context);
+                    std::erase_if(context.positions, [&](position_t pos) { return not verify(pos, query); });
+                    return context.positions;
+                }
 
-                    if (q < _all_ks.front())
-                    {
-                        size_t optimal_k = _all_ks.front();
-                        for (size_t k : _all_ks)
-                        {
-                            if (q <= k and (k - q < optimal_k - q))
-                            {
-                                optimal_k = k;
-                                continue;
-                            }
-                        }
-                        _optimal_nk_sum[q] = {optimal_k};
-                    }
-                    else
-                    {
-                        size_t optimal_k = _all_ks.front();
-                        for (size_t k : _all_ks)
-                        {
-                            if ((ceil(q / float(k)) * k - q) <
-                                (ceil(q / float(optimal_k)) * optimal_k - q))
-                                optimal_k = k;
-                        }
+                if (not _use_multi_search_scheme[query.size()] or _all_ks.size() == 1)
+                    return (this->*(_search_into_fns[_k_to_search_fns_i.at(_optimal_nk_sum.at(query.size()).at(0))]))(query, context);
 
-                        _optimal_nk_sum[q] = {optimal_k};
-                    }
-                }
+                context.positions.clear();
+                context.lists.clear();
+                context.shifts.clear();
+                if (not search_parts(query, context.lists, context.shifts))
+                    return context.positions;
+
+                if (context.lists.size() == 1)
+                    return context.lists.front().plain_or_decode(context.positions);
+
+                detail::intersect(context.lists, context.shifts, context.positions, context.intersection);
+                return context.positions;
             }
 
-        public:
-            // CTOR
-            template<std::ranges::range text_t>
-            kmer_index(text_t& text, size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u))
-                    : index_element_t<ks>()...
+            // search query allowing up to max_errors substitutions (c.f. [13])
+            result_t search_approximate(std::vector<alphabet_t>& query, size_t max_errors) const
             {
-                // construct each element in paralell
-                auto pool = detail::thread_pool{n_threads};
-                std::vector<std::future<void>> futures;
-                (futures.emplace_back(
-                        pool.execute(&index_element_t<ks>::template create<text_t>,
-                                     static_cast<index_element_t<ks>*>(this),
-                                     std::ref(text))), ...);
-                for (auto& f : futures)
-                    f.get();
+                if (max_errors == 0)
+                    return search(query);
 
-                setup_k_to_search_fn();
-                choose_search_scheme();
+                if (query.size() <= max_errors)
+                    throw std::invalid_argument("query size has to be larger than the number of errors");
+
+                if (not _keep_text)
+                    throw std::invalid_argument("search_approximate needs an index constructed with APPROXIMATE_SEARCH::ENABLED");
+
+                std::vector<position_t> candidates;
+                append_approximate(query, max_errors, candidates);
+
+                if (_orientation == ORIENTATION::CANONICAL)
+                {
+                    auto reverse = reverse_complement(query);
+                    append_approximate(reverse, max_errors, candidates);
+
+                    std::sort(candidates.begin(), candidates.end());
+                    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+                }
+
+                if (candidates.empty())
+                    return result_t();
+
+                result_t output(std::move(candidates), true, detail::BYPASS_BITMASK::YES);
+                output.set_sequence_starts(_sequence_starts.view());
+                return output;
             }
 
-            void extend_query_size_range(size_t new_maximum)
+            // overload for rvalue
+            result_t search_approximate(std::vector<alphabet_t>&& query, size_t max_errors) const
             {
-                _query_size_range = new_maximum;
-                choose_search_scheme();
+                auto hold = query;
+                return search_approximate(hold, max_errors);
             }
 
-            // search any query
-            result_t search(std::vector<alphabet_t>& query) const
+            // number of occurrences of query, cheaper than search(query).size() (c.f. [11])
+            size_t count(std::vector<alphabet_t>& query) const
             {
-                if (query.size() > _query_size_range)
+                search_context context;
+                return count(query, context);
+            }
+
+            // overload that only uses the memory of context, which does not allocate once it has grown
+            size_t count(std::vector<alphabet_t>& query, search_context& context) const
+            {
+                if (query.size() >= _query_size_range)
                     throw(std::invalid_argument("query size exceed the maximum size "
                         + std::to_string(_query_size_range) + " specified"));
 
-                // if rest present just use regular searching
+                // candidates of both strands, of minimizers or of spaced seeds have to be verified
+                if ((_orientation == ORIENTATION::CANONICAL and not is_single_lookup(query.size()))
+                    or (_sampled and is_sampled(scheme_k(query.size()))))
+                    return search(query, context).size();
+
                 if (not _use_multi_search_scheme[query.size()] or _all_ks.size() == 1)
-                    return (this->*(_search_fns[_k_to_search_fns_i.at(_optimal_nk_sum.at(query.size()).at(0))]))(query);
+                    return (this->*(_count_fns[_k_to_search_fns_i.at(_optimal_nk_sum.at(query.size()).at(0))]))(query, context);
 
-                // split query into kmers with different k and search each part with appropriate index element
-                std::vector<const std::vector<position_t>*> nk_positions;
-                size_t last_k = 0;
-                for (size_t current_k : _optimal_nk_sum[query.size()])
-                {
-                    const auto* pos = (this->*_search_k_fns[_k_to_search_fns_i.at(current_k)])(query.begin() + last_k);
-                    if (pos)
-                        nk_positions.push_back(pos);
-                    else
-                        return result_t();
+                context.lists.clear();
+                context.shifts.clear();
+                if (not search_parts(query, context.lists, context.shifts))
+                    return 0;
 
-                    last_k = current_k;
-                }
+                return detail::count_common(context.lists, context.shifts, context.positions, context.intersection);
+            }
 
-                if (nk_positions.size() == 1)
-                    return result_t(nk_positions.at(0), true, detail::BYPASS_BITMASK::YES);
+            // overload for rvalue
+            size_t count(std::vector<alphabet_t>&& query) const
+            {
+                auto hold = query;
+                return count(hold);
+            }
+
+            // search many queries, the lookups of groups of queries are prefetched stage by stage before
+            // resolving them one after another, so their cache misses overlap (c.f. [8])
+            std::vector<result_t> search_batch(std::span<std::vector<alphabet_t>> queries) const
+            {
+                std::vector<result_t> output;
+                output.reserve(queries.size());
 
-                result_t output(nk_positions.at(0), true, detail::BYPASS_BITMASK::NO);
+                bool canonical = _orientation == ORIENTATION::CANONICAL;
+                batch_state state;
+                search_context context;
 
-                // crossreference the part positions
-                size_t nk_sum_i = 0;
-                for (size_t start_pos_i = 0; start_pos_i < nk_positions.front()->size(); ++start_pos_i)
+                for (size_t group_begin = 0; group_begin < queries.size(); group_begin += _prefetch_group_size)
                 {
-                    size_t previous_pos = nk_positions.front()->at(start_pos_i);
+                    size_t group_end = std::min(group_begin + _prefetch_group_size, queries.size());
 
-                    bool interrupted = false;
-                    for (size_t next_pos_i = 1; next_pos_i < nk_positions.size(); ++next_pos_i)
+                    state.lists.clear();
+                    state.query_lists.clear();
+
+                    // hash every kmer and prefetch the first access of its lookup
+                    for (size_t i = group_begin; i < group_end; ++i)
                     {
-                        const auto* current = nk_positions.at(next_pos_i);
-                        auto it = std::lower_bound(current->begin(), current->end(), previous_pos += _optimal_nk_sum.at(query.size()).at(nk_sum_i));
+                        auto& query = queries[i];
 
-                        if (*it != previous_pos)
+                        if (not is_batched(query.size()))
                         {
-                            interrupted = true;
-                            break;
+                            state.query_lists.emplace_back(0, 0);
+                            continue;
                         }
+
+                        state.query_lists.push_back(start_lookups(state, query));
                     }
 
-                    if (interrupted)
-                        output.should_not_use(start_pos_i);
+                    for (size_t stage = 1; stage < detail::_n_prefetch_stages; ++stage)
+                        (prefetch_lookups<ks>(state, stage), ...);
+
+                    (resolve_lookups<ks>(state), ...);
+
+                    for (size_t i = group_begin; i < group_end; ++i)
+                    {
+                        auto& query = queries[i];
+                        auto [first, n] = state.query_lists[i - group_begin];
+
+                        if (n == 0)
+                        {
+                            output.push_back(search(query));
+                            continue;
+                        }
+
+                        std::span<const detail::position_list<position_t>> lists(state.lists.data() + first, n);
+
+                        if (not canonical or is_single_lookup(query.size()))
+                        {
+                            output.push_back(search_scheme(query, lists));
+                            continue;
+                        }
+
+                        // the lists of canonical kmers hold both strands, which are told apart when verifying
+                        context.lists.assign(lists.begin(), lists.end());
+                        resolve_strands(query, context);
+                        output.push_back(make_result(context));
+                    }
                 }
 
                 return output;
             }
 
-            // overload for rvalue
-            result_t search(std::vector<alphabet_t>&& query) const
+            // search many queries with n_threads threads, results are in the order of queries (c.f. [15])
+            // the threads are reused from earlier calls
+            std::vector<result_t> search_parallel(std::span<std::vector<alphabet_t>> queries,
+                                                  size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u)) const
             {
-                auto hold = query;
-                search(hold);
+                assert(n_threads > 0);
+
+                size_t n_chunks = (queries.size() + _parallel_chunk_size - 1) / _parallel_chunk_size;
+                n_threads = std::min(n_threads, n_chunks);
+
+                if (n_threads <= 1)
+                    return search_batch(queries);
+
+                auto pool = get_pool(n_threads);
+                return search_parallel(queries, *pool, n_threads);
+            }
+
+            // search many queries with n_threads tasks on a pool owned by the caller (c.f. [15])
+            // must not be called from a task of the same pool
+            std::vector<result_t> search_parallel(std::span<std::vector<alphabet_t>> queries,
+                                                  detail::thread_pool& pool,
+                                                  size_t n_threads) const
+            {
+                assert(n_threads > 0);
+
+                size_t n_chunks = (queries.size() + _parallel_chunk_size - 1) / _parallel_chunk_size;
+                n_threads = std::min(n_threads, n_chunks);
+
+                if (n_threads <= 1)
+                    return search_batch(queries);
+
+                // each chunk is searched by one thread into its own buffer, threads claim the next chunk when done
+                std::vector<std::vector<result_t>> chunk_results(n_chunks);
+                std::atomic<size_t> next_chunk = 0;
+
+                // a throwing search stops all threads and is rethrown to the caller
+                std::exception_ptr error;
+                std::mutex error_mutex;
+
+                detail::parallel_for(pool, n_threads, [&](size_t)
+                {
+                    try
+                    {
+                        for (size_t chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++)
+                        {
+                            size_t begin = chunk * _parallel_chunk_size;
+                            size_t size = std::min(_parallel_chunk_size, queries.size() - begin);
+                            chunk_results[chunk] = search_batch(queries.subspan(begin, size));
+                        }
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (not error)
+                            error = std::current_exception();
+
+                        next_chunk = n_chunks;
+                    }
+                });
+
+                if (error)
+                    std::rethrow_exception(error);
+
+                std::vector<result_t> output;
+                output.reserve(queries.size());
+
+                for (auto& results : chunk_results)
+                    for (auto& result : results)
+                        output.push_back(std::move(result));
+
+                return output;
             }
     };
 
     // convenient creation function that only takes the ks and picks everything else on it's own
     template<size_t... ks, std::ranges::range text_t>
-    auto make_kmer_index(text_t && text, size_t n_threads = std::thread::hardware_concurrency())
+    auto make_kmer_index(text_t && text,
+                         size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u),
+                         const kmer_index_options& options = {})
     {
         assert(n_threads > 0);
 
@@ -575,7 +3105,7 @@ namespace kmer
         using position_t = uint32_t;
         using hash_t = uint64_t;
 
-        return kmer_index<alphabet_t, position_t, ks...>(std::forward<text_t>(text), n_threads);
+        return kmer_index<alphabet_t, position_t, ks...>(std::forward<text_t>(text), n_threads, options);
     }
 
 } // end of namespace kmer
@@ -598,6 +3128,222 @@ namespace kmer
 // value optimization as such:
 //
 // size_t k = 3;
-// const auto* pos = (this->*_search_k_fns[k])(query);
+// auto pos = (this->*_search_k_fns[k])(query);
+//
+// ###################################
+
+// ###################################
+//
+// [2]
+//
+// For small k the hashspace sigma^k is small enough to allocate one offset per possible hash. The positions of
+// all kmers are then stored in one vector sorted by hash and _offsets[h] marks where the positions of h start, so
+// a lookup is two adjacent loads instead of a hash map probe. Hashes with the same prefix are adjacent, which
+// turns a prefix query (m < k) into a range of _offsets. If the hashspace exceeds _direct_addressing_factor times
+// the number of kmers, the offsets would be mostly empty and sorted keys are used instead (c.f. [3]).
+// With POSITION_ENCODING::ELIAS_FANO the positions are compressed (c.f. elias_fano.hpp) and only those that end
+// up in the result are decoded.
+//
+// ###################################
+
+// ###################################
+//
+// [3]
+//
+// Every element keeps its data in flat arrays so the index can be stored (c.f. serialization.hpp). Hashspaces too
+// large to be addressed directly keep a sorted array of all occurring hashes (_keys) with the same offset and
+// position layout, plus a directory over the highest bits of the hash so that finding a key is one directory load
+// and a search over the few keys of one cell.
+// save writes a header, the arrays of each element and the search scheme. load memory maps the file and lets each
+// element view its arrays in place, so processes loading the same file share the page cache.
+//
+// ###################################
+
+// ###################################
+//
+// [4]
+//
+// The hash of a kmer is its rank-wise representation in base sigma, so a 64-bit hash limits k to 31 for dna4.
+// Each element picks the smallest of uint64_t, unsigned __int128 and detail::uint256_t that holds sigma^k
+// (c.f. hash_types.hpp). Wide hashes are never addressed directly and are rolled by hand during construction,
+// because seqan3::views::kmer_hash only produces 64-bit hashes.
+//
+// ###################################
+
+// ###################################
+//
+// [5]
+//
+// A text whose elements are ranges is indexed as a collection. Positions are global, sequence i starts after all
+// previous sequences plus one unused position each, so no kmer and no pair of adjacent query parts can span two
+// sequences. The tails of every sequence are checked instead of only those of the end of the text.
+// kmer_index_result converts global positions to (sequence id, offset) through _sequence_starts.
+//
+// ###################################
+
+// ###################################
+//
+// [6]
+//
+// Each element is constructed with all threads: the kmers are split into one chunk per thread and the hashspace
+// into shards by the highest bits of the hash. Every chunk counts its kmers per shard and then scatters
+// (hash, position) into the range of each shard, in chunk order so positions stay ascending. The shards are then
+// bucketed independently and end up adjacent, giving the same element as a sequential construction. A text too
+// small to split is read directly with a single shard, and its elements are constructed concurrently, one task per k.
+//
+// ###################################
+
+// ###################################
+//
+// [7]
+//
+// Collecting positions in a hash map of vectors costs several map operations per kmer and regrows every vector.
+// Instead each shard first counts the occurrences of every hash, which fixes the size of each bucket, then a second
+// pass writes every position directly into its bucket of the final array (c.f. detail::bucket_sparse).
+//
+// ###################################
+
+// ###################################
+//
+// [8]
+//
+// A lookup is a chain of dependent loads (offsets then positions, or directory, keys, offsets and positions),
+// each usually a cache miss. search_batch resolves groups of queries in stages: in stage i every lookup of the
+// group prefetches its i-th access, which only depends on memory prefetched in the stage before, so the misses of
+// the whole group overlap. Each kmer is hashed once and its key is searched once, the queries are then resolved
+// from the lists found. Prefix ranges are not prefetched, queries shorter than their k are searched regularly.
+//
+// ###################################
+
+// ###################################
 //
-// ###################################
\ No newline at end of file
+// [9]
+//
+// A query of size m > k is searched as m / k non-overlapping blocks of size k and a rest prefix. For alphabets
+// whose size is a power of two with 64-bit hashes the query is packed once (c.f. packed_text.hpp [1]) and every
+// block hash is cut out of it with two shifts, otherwise each hash is computed by the unrolled fold.
+//
+// ###################################
+
+// ###################################
+//
+// [10]
+//
+// A query of size m < k occurs wherever a kmer with it as prefix occurs, whose hashes are [h, h + sigma^(k - m))
+// with h the prefix padded with rank 0. Since _keys is sorted, the occurring ones are found with two directory
+// lookups and are adjacent, so short queries cost the number of distinct kmers with the prefix.
+//
+// ###################################
+
+// ###################################
+//
+// [11]
+//
+// count avoids building a kmer_index_result. For m = k it is the size of one bucket, for m < k the difference of
+// two offsets plus the matching tails (c.f. [10]). Longer queries intersect all lists but the last as search
+// does and only count the candidates found in it, using the memory of a search_context.
+//
+// ###################################
+
+// ###################################
+//
+// [12]
+//
+// An absent kmer in a sparse element still costs a directory load and a search over the keys of a cell. With
+// MEMBERSHIP_FILTER::BLOOM each sparse element keeps a blocked bloom filter over _keys (c.f. bloom_filter.hpp
+// [1]) that rejects most absent kmers with a single cache line. Directly addressed elements ignore it.
+//
+// ###################################
+
+// ###################################
+//
+// [13]
+//
+// If a query occurs with at most e substitutions, one of e + 1 disjoint parts of it occurs exactly (pigeonhole
+// principle). search_approximate cuts the query into e + 1 slices and searches the prefix of each slice whose size
+// is the largest k that fits, so every part is a single lookup, or the whole slice if no k fits. The hits are
+// shifted by the offset of their part and every distinct candidate is verified once against a packed copy of the
+// text, discarding candidates that span two sequences. The packed text is only kept if the index is constructed
+// with APPROXIMATE_SEARCH::ENABLED or needs it to verify candidates (c.f. [14], [18], [19]), otherwise
+// search_approximate throws.
+//
+// ###################################
+
+// ###################################
+//
+// [14]
+//
+// DNA is double stranded, so a query also occurs wherever its reverse complement does. With
+// ORIENTATION::CANONICAL a kmer is stored under the smaller of its hash and the hash of its reverse complement,
+// so a query of size k finds both strands with one lookup. Longer queries look up each block once and intersect
+// the lists once per strand, shorter ones collect the kmers with the query as prefix or the reverse complement of
+// the query as suffix. Canonical hashes lose the prefix order of the kmers that are stored as their reverse
+// complement, so sparse elements also keep the reverse complements of their keys sorted, and both kinds of
+// keys are found as one range each (c.f. [10]). All candidates are verified against the packed text (c.f. [13]).
+// Canonical mode needs hashes that fit into 64 bit.
+//
+// ###################################
+
+// ###################################
+//
+// [15]
+//
+// Searching only reads the index, so search_parallel lets one task per thread claim chunks of consecutive
+// queries through an atomic counter and search them with search_batch (c.f. [8]). Every chunk writes its own
+// buffer and the buffers are concatenated in order. The thread pool is created by the first parallel search and
+// kept by the index, callers can pass a pool of their own instead.
+//
+// ###################################
+
+// ###################################
+//
+// [16]
+//
+// search(query) allocates a kmer_index_result and its temporaries for every query. search(query, context) keeps
+// all of them in a search_context owned by the caller, whose vectors keep their capacity, so once they have grown
+// searching does not allocate. The sorted positions are returned as a span that is valid until the context is
+// used again.
+//
+// ###################################
+
+// ###################################
+//
+// [17]
+//
+// Each element stores every position once, so memory grows with the number of ks. With POSITION_ENCODING::SHARED
+// all positions are stored once, sorted by the kmer of the largest k starting at them, which keeps the positions
+// of any shorter kmer adjacent, and each element only keeps its own offsets into them. Positions too close to the
+// end of their sequence sort to the front of their bucket and are skipped through a small table. Only the buckets
+// of the largest k are ascending, so the other ks only answer queries of their own size.
+//
+// ###################################
+
+// ###################################
+//
+// [18]
+//
+// With a minimizer window w > 1 an element only stores, of every w consecutive kmers of a sequence, the one of
+// smallest order, which is a bijective mix of the hash. Every occurrence of a query of size at least w + k - 1
+// stores the minimizers of the windows of the query, so the element shifts the smallest of their lists by its
+// offset and kmer_index verifies the candidates against the packed text. Each query uses the largest k whose window
+// fits into it. The smallest k always stores all of its kmers, so shorter queries are still looked up instead of
+// being compared against the whole text, which is why minimizers need at least two ks.
+//
+// ###################################
+
+// ###################################
+//
+// [19]
+//
+// A spaced seed only hashes the k characters at the set bits of a shape of span s > k. Seeds at neighbouring
+// offsets look at mostly different characters, so at the same hash space more of them survive substitutions
+// than contiguous kmers. Prefix lookups and blocks need contiguous kmers, so an element with a gapped shape is
+// searched like one storing minimizers (c.f. [18]), with the span in place of k. Queries shorter than the span of
+// every element throw, so the smallest k is usually given the ungapped shape 0.
+//
+// The shape is a runtime value of each element rather than part of its type: it is saved with the element and
+// checked before any element is constructed, so the number of template instances stays one per k. A query is not
+// split into several gapped blocks either, it is answered by its rarest seed of the largest k whose span fits and
+// every candidate is verified against the text.
+//
+// ###################################
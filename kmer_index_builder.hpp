@@ -0,0 +1,167 @@
+//
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+//
+
+#pragma once
+
+#include <seqan3/alphabet/concept.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <kmer_index.hpp>
+#include <packed_text.hpp>
+
+namespace kmer
+{
+    // builds a kmer_index from a text that arrives in chunks, for example while reading a file (c.f. [1])
+    // alphabet_t   :   the alphabet of the text
+    // position_t   :   the primitive used for positional indices
+    // ks           :   the ks of the index
+    template<seqan3::alphabet alphabet_t, typename position_t, size_t... ks>
+    class kmer_index_builder
+    {
+        private:
+            using index_t = kmer_index<alphabet_t, position_t, ks...>;
+
+            // the text so far, sequences are separated by one character like in the index (c.f. kmer_index.hpp [5])
+            detail::packed_text<alphabet_t> _text;
+            std::vector<size_t> _sequence_sizes;
+
+        public:
+            // CTOR
+            kmer_index_builder() = default;
+
+            // start a new sequence, the text becomes a collection of sequences (c.f. kmer_index.hpp [5])
+            // the first sequence is started implicitly
+            void start_sequence()
+            {
+                if (not _sequence_sizes.empty())
+                    _text.push_back(alphabet_t{});
+
+                _sequence_sizes.push_back(0);
+            }
+
+            // append chunk to the current sequence, chunks can have any size
+            template<std::ranges::range chunk_t>
+            void append(const chunk_t& chunk)
+            {
+                if (std::ranges::empty(chunk))
+                    return;
+
+                if (_sequence_sizes.empty())
+                    start_sequence();
+
+                for (auto c : chunk)
+                {
+                    _text.push_back(c);
+                    ++_sequence_sizes.back();
+                }
+            }
+
+            size_t n_sequences() const
+            {
+                return _sequence_sizes.size();
+            }
+
+            // construct the index from all chunks appended so far, the builder is empty afterwards
+            index_t finalize(size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u),
+                             const kmer_index_options& options = {})
+            {
+                if (_sequence_sizes.empty())
+                    throw std::invalid_argument("no text was appended to the builder");
+
+                // the packed text is moved into the index instead of being packed a second time
+                auto text = std::move(_text);
+                auto sequence_sizes = std::move(_sequence_sizes);
+
+                _text = detail::packed_text<alphabet_t>();
+                _sequence_sizes.clear();
+
+                return index_t(std::move(text), sequence_sizes, n_threads, options);
+            }
+    };
+
+    // build index from a (multi-)FASTA file without holding the unpacked text in memory,
+    // each record becomes one sequence of the indexed collection
+    // characters that are not valid for alphabet_t, for example N in dna4, throw instead of being converted
+    template<seqan3::alphabet alphabet_t, size_t... ks>
+    auto make_kmer_index_from_fasta(const std::string& path,
+                                    size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u),
+                                    const kmer_index_options& options = {})
+    {
+        assert(n_threads > 0);
+
+        using position_t = uint32_t;
+
+        auto file = std::ifstream(path, std::ios::binary);
+        if (not file)
+            throw std::runtime_error("unable to open " + path);
+
+        auto builder = kmer_index_builder<alphabet_t, position_t, ks...>();
+
+        constexpr size_t chunk_size = 1 << 20;
+        std::vector<char> buffer(chunk_size);
+        std::vector<alphabet_t> chunk;
+        chunk.reserve(chunk_size);
+
+        // header lines can span chunks, so the state is carried over
+        bool in_header = false;
+
+        while (file)
+        {
+            file.read(buffer.data(), chunk_size);
+            size_t n_read = file.gcount();
+
+            chunk.clear();
+            for (size_t i = 0; i < n_read; ++i)
+            {
+                char c = buffer[i];
+
+                if (in_header)
+                {
+                    in_header = c != '\n';
+                }
+                else if (c == '>')
+                {
+                    builder.append(chunk);
+                    chunk.clear();
+
+                    builder.start_sequence();
+                    in_header = true;
+                }
+                else if (not std::isspace(static_cast<unsigned char>(c)))
+                {
+                    // assign_char_to would silently map them to some other character
+                    if (not seqan3::char_is_valid_for<alphabet_t>(c))
+                        throw std::invalid_argument(std::string("character '") + c + "' in " + path
+                                                    + " is not part of the alphabet");
+
+                    chunk.push_back(seqan3::assign_char_to(c, alphabet_t{}));
+                }
+            }
+
+            builder.append(chunk);
+        }
+
+        return builder.finalize(n_threads, options);
+    }
+} // end of namespace kmer
+
+// ###################################
+//
+// [1]
+//
+// kmer_index needs the whole text to construct its elements. Instead of keeping every chunk in memory as it
+// arrives, the builder appends them to a packed text with the minimal number of bits per character, which is a
+// random access range of alphabet_t. Sequences are separated by one character, so it is laid out exactly like the
+// text the index keeps for verification (c.f. kmer_index.hpp [13]) and finalize moves it into the index, which
+// releases it afterwards unless it is needed. Kmers spanning chunk boundaries need no special handling.
+//
+// ###################################
@@ -4,183 +4,209 @@
 
 #include <kmer_index.hpp>
 #include <compressed_bitset.hpp>
+#include <intersection.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
 
 namespace kmer::detail
 {
     // if bitmask bypassed, skip operator arithmetics and treat bitmask as all 11111...11
     enum class BYPASS_BITMASK : bool {YES = true, NO = false};
 
+    // whether the positions handed to a result are already ascending, known by whoever produces them
+    enum class SORTED_POSITIONS : bool {YES = true, NO = false};
+
     // container for kmer index results (c.f. [1])
     template<typename position_t>
     class kmer_index_result
     {
         private:
             compressed_bitset<uint_fast64_t> _bitmask;
-            const bool _bypass_bitmask;
-            const size_t _n_results;
+            bool _bypass_bitmask;
+            bool _sorted = true;
+            size_t _n_results;
+
+            // views of positions inside kmer_index_element, ascending if there is more than one
+            // results with a bitmask that is not bypassed only hold one view, which is ascending if _sorted
+            std::vector<std::span<const position_t>> _positions;
+
 
-            // pointers to positions inside kmer_index::_data
-            std::vector<const std::vector<position_t>*> _positions;
+            // positions that had to be decoded from a compressed representation are owned by the result
+            std::vector<position_t> _owned_positions;
+
+            // global position of the first character of each sequence if the index holds a collection
+            std::span<const position_t> _sequence_starts;
 
         protected:
+            // bidirectional iterator over the valid positions in the order they are stored (c.f. [2])
             class kmer_index_result_iterator
             {
                 friend class kmer_index_result<position_t>;
 
                 private:
-                    const kmer_index_result<position_t> *_result;
+                    const kmer_index_result<position_t>* _result = nullptr;
+
+                    // index of the current position among all positions, get_n_results() for the end
                     size_t _position_i = 0;
 
-                    // first and last valid index for the positions, computed at construction
-                    size_t _first_valid_i, _last_valid_i;
+                    // the current position is _result->_positions[_span_i][_offset]
+                    size_t _span_i = 0;
+                    size_t _offset = 0;
 
-                    bool advance_to_next_valid_result()
+                    // first valid index at or after i, get_n_results() if there is none
+                    size_t next_valid(size_t i) const
                     {
-                        if (_position_i == _last_valid_i)
-                            return false;
-
-                        size_t new_i = _position_i + 1;
+                        if (_result->_bypass_bitmask)
+                            return std::min(i, _result->get_n_results());
 
-                        while (new_i < _result->get_n_results() and _result->is_valid(new_i) == false)
-                            new_i++;
+                        return _result->_bitmask.next_1(i);
+                    }
 
-                        assert(new_i != _position_i);
+                    // last valid index at or before i, get_n_results() if there is none
+                    size_t previous_valid(size_t i) const
+                    {
+                        if (_result->_bypass_bitmask)
+                            return _result->get_n_results() == 0 ? 0 : std::min(i, _result->get_n_results() - 1);
 
-                        _position_i = new_i;
-                        return true;
+                        return _result->_bitmask.previous_1(i);
                     }
 
-                    bool advance_to_previous_valid_result()
+                    // move the span cursor to index i, walking over the spans in between
+                    void seek(size_t i)
                     {
-                        if (_position_i == _first_valid_i)
-                            return false;
+                        const auto& spans = _result->_positions;
+
+                        if (i >= _position_i)
+                        {
+                            _offset += i - _position_i;
+                            while (_span_i < spans.size() and _offset >= spans[_span_i].size())
+                                _offset -= spans[_span_i++].size();
+                        }
+                        else
+                        {
+                            // the end of the previous span is the same index as the start of the current one
+                            size_t n_back = _position_i - i;
+                            while (n_back > _offset)
+                            {
+                                n_back -= _offset;
+                                _offset = spans[--_span_i].size();
+                            }
+                            _offset -= n_back;
+                        }
 
-                        size_t new_i = _position_i - 1;
+                        _position_i = i;
+                    }
 
-                        while (new_i > 0 and _result->is_valid(new_i) == false)
-                            new_i--;
+                    void advance_to_next_valid_result()
+                    {
+                        if (_position_i < _result->get_n_results())
+                            seek(next_valid(_position_i + 1));
+                    }
 
-                        assert(new_i != _position_i);
+                    void advance_to_previous_valid_result()
+                    {
+                        if (_position_i == 0)
+                            return;
 
-                        _position_i = new_i;
-                        return true;
+                        size_t previous = previous_valid(_position_i - 1);
+                        if (previous != _result->get_n_results())
+                            seek(previous);
                     }
 
                 protected:
-                    kmer_index_result_iterator(kmer_index_result<position_t> *result, bool start_at_beginning_or_end)
-                            : kmer_index_result_iterator(result)
+                    kmer_index_result_iterator(const kmer_index_result<position_t>* result, bool start_at_beginning_or_end)
+                            : _result(result)
                     {
+                        // skip empty spans at the front
+                        seek(0);
+
                         if (start_at_beginning_or_end)
-                        {
-                            if (not _result->_bitmask.at(0))
-                                advance_to_next_valid_result();
-                        }
+                            seek(next_valid(0));
                         else
-                        {
-                            _position_i = _last_valid_i + 1;
-                        }
+                            seek(_result->get_n_results());
                     }
 
                 public:
-                    using iterator_category = std::bidirectional_iterator_tag;
+                    // positions are handed out by value, so for legacy algorithms this is only an input iterator
+                    using iterator_concept = std::bidirectional_iterator_tag;
+                    using iterator_category = std::input_iterator_tag;
                     using value_type = position_t;
-                    using difference_type = void;
+                    using difference_type = std::ptrdiff_t;
                     using pointer = void;
-                    using reference = void;
+                    using reference = position_t;
 
                     // typedef for readability
                     using iterator_t = kmer_index_result<position_t>::kmer_index_result_iterator;
 
                     // CTOR
-                    kmer_index_result_iterator(kmer_index_result<position_t> *result)
-                            : _result(result), _position_i(0)
-                    {
-                        size_t i = result->_bitmask.size() - 1;
-                        for (i; i >= 0; i--)
-                            if (result->_bitmask.at(i))
-                                break;
+                    kmer_index_result_iterator() = default;
 
-                        _last_valid_i = i;
+                    explicit kmer_index_result_iterator(const kmer_index_result<position_t>* result)
+                            : kmer_index_result_iterator(result, true)
+                    {}
 
-                        if (not result->_bitmask.at(0))
-                        {
-                            advance_to_next_valid_result();
-                            _first_valid_i = _position_i;
-                        }
-                        else
-                            _first_valid_i = 0;
+                    iterator_t& operator++()
+                    {
+                        advance_to_next_valid_result();
+                        return *this;
                     }
 
-                    iterator_t &operator++()
+                    iterator_t operator++(int)
                     {
+                        auto out = *this;
                         advance_to_next_valid_result();
-                        return *this;
+                        return out;
                     }
 
-                    iterator_t &operator+=(int i)
+                    iterator_t& operator--()
                     {
-                        if (i > 0)
-                        {
-                            while (i > 0)
-                            {
-                                advance_to_next_valid_result();
-                                i--;
-                            }
-                            return *this;
-                        }
-                        else
-                        {
-                            while (i < 0)
-                            {
-                                advance_to_previous_valid_result();
-                                i++;
-                            }
-                            return *this;
-                        }
+                        advance_to_previous_valid_result();
+                        return *this;
                     }
 
-                    iterator_t &operator--()
+                    iterator_t operator--(int)
                     {
+                        auto out = *this;
                         advance_to_previous_valid_result();
+                        return out;
+                    }
+
+                    iterator_t& operator+=(int i)
+                    {
+                        for (; i > 0; --i)
+                            advance_to_next_valid_result();
+
+                        for (; i < 0; ++i)
+                            advance_to_previous_valid_result();
+
                         return *this;
                     }
 
-                    iterator_t &operator-=(int i)
+                    iterator_t& operator-=(int i)
                     {
-                        if (i > 0)
-                        {
-                            while (i > 0)
-                            {
-                                advance_to_previous_valid_result();
-                                i--;
-                            }
-                            return *this;
-                        }
-                        else
-                        {
-                            while (i < 0)
-                            {
-                                advance_to_next_valid_result();
-                                i++;
-                            }
-                            return this;
-                        }
+                        return *this += -i;
                     }
 
-                    bool operator==(iterator_t other)
+                    bool operator==(const iterator_t& other) const
                     {
                         return this->_position_i == other._position_i and this->_result == other._result;
                     }
 
-                    bool operator!=(iterator_t other)
+                    bool operator!=(const iterator_t& other) const
                     {
                         return not(*this == other);
                     }
 
-                    value_type operator*()
+                    position_t operator*() const
                     {
-                        auto result = _result->at(_position_i);
-                        return result;
+                        return _result->_positions[_span_i][_offset];
                     }
             };
 
@@ -205,19 +231,63 @@ namespace kmer::detail
             {
             }
 
-            kmer_index_result(const std::vector<position_t> *positions, bool fill_with_zero_or_ones, BYPASS_BITMASK bypass_bitmask)
-                    : _bitmask((bool(bypass_bitmask) ? 0 : positions->size()), fill_with_zero_or_ones), _bypass_bitmask(bool(bypass_bitmask)), _n_results(positions->size())
+            kmer_index_result(std::span<const position_t> positions, bool fill_with_zero_or_ones, BYPASS_BITMASK bypass_bitmask,
+                              SORTED_POSITIONS sorted = SORTED_POSITIONS::YES)
+                    : _bitmask((bool(bypass_bitmask) ? 0 : positions.size()), fill_with_zero_or_ones), _bypass_bitmask(bool(bypass_bitmask)),
+                      _sorted(bool(sorted)), _n_results(positions.size())
             {
                 _positions = {positions};
             }
 
-            kmer_index_result(std::vector<const std::vector<position_t>*> positions)
+            kmer_index_result(std::vector<position_t>&& positions, bool fill_with_zero_or_ones, BYPASS_BITMASK bypass_bitmask,
+                              SORTED_POSITIONS sorted = SORTED_POSITIONS::YES)
+                    : _bitmask((bool(bypass_bitmask) ? 0 : positions.size()), fill_with_zero_or_ones), _bypass_bitmask(bool(bypass_bitmask)),
+                      _sorted(bool(sorted)), _n_results(positions.size()),
+                      _owned_positions(std::move(positions))
+            {
+                _positions = {std::span<const position_t>(_owned_positions)};
+            }
+
+            kmer_index_result(const kmer_index_result& other)
+                    : _bitmask(other._bitmask), _bypass_bitmask(other._bypass_bitmask), _sorted(other._sorted), _n_results(other._n_results),
+                      _positions(other._positions), _owned_positions(other._owned_positions),
+                      _sequence_starts(other._sequence_starts)
+            {
+                if (not _owned_positions.empty())
+                    _positions = {std::span<const position_t>(_owned_positions)};
+            }
+
+            kmer_index_result(kmer_index_result&&) = default;
+
+            kmer_index_result& operator=(const kmer_index_result& other)
+            {
+                if (this == &other)
+                    return *this;
+
+                _bitmask = other._bitmask;
+                _bypass_bitmask = other._bypass_bitmask;
+                _sorted = other._sorted;
+                _n_results = other._n_results;
+                _positions = other._positions;
+                _owned_positions = other._owned_positions;
+                _sequence_starts = other._sequence_starts;
+
+                if (not _owned_positions.empty())
+                    _positions = {std::span<const position_t>(_owned_positions)};
+
+                return *this;
+            }
+
+            // moving a vector keeps its memory, so views of _owned_positions stay valid
+            kmer_index_result& operator=(kmer_index_result&&) = default;
+
+            kmer_index_result(std::vector<std::span<const position_t>> positions)
                     : _bitmask(0, true),
                       _bypass_bitmask(true),
                       _n_results([&]() -> size_t {
                             size_t n = 0;
                             for (const auto vec : positions)
-                                n += vec->size();
+                                n += vec.size();
                             return n;
                         }())
             {
@@ -238,38 +308,99 @@ namespace kmer::detail
             // number of valid positions
             size_t size() const
             {
+                // a bypassed bitmask is empty
+                if (_bypass_bitmask)
+                    return _n_results;
+
                 return _bitmask.count_bits_equal_to(true);
             }
 
+            // valid positions in ascending order
             std::vector<position_t> to_vector() const
             {
+                std::vector<position_t> output;
+                to_vector(output);
+                return output;
+            }
+
+            // overload that writes into output, reusing its memory
+            void to_vector(std::vector<position_t>& output) const
+            {
+                output.clear();
+
                 if (_positions.empty())
-                    return std::vector<position_t>();
+                    return;
 
-                std::vector<position_t> output;
+                if (_positions.size() == 1)
+                {
+                    if (_bypass_bitmask)
+                        output.assign(_positions.front().begin(), _positions.front().end());
+                    else
+                    {
+                        // only the set bits are visited (c.f. [2])
+                        output.reserve(size());
+                        for (position_t pos : *this)
+                            output.push_back(pos);
+                    }
+
+                    // only producers that did not hand over ascending positions need sorting
+                    if (not _sorted)
+                        std::sort(output.begin(), output.end());
+                }
+                else
+                {
+                    // the views are sorted runs already (c.f. intersection.hpp [2])
+                    std::vector<position_t> scratch;
+                    std::vector<size_t> bounds;
+                    merge_runs(_positions, output, scratch, bounds);
+                }
+            }
 
-                size_t i = 0;
-                for (const auto *vec : _positions)
-                    for (size_t j = 0; j < vec->size(); ++j, ++i)
-                        if (is_valid(i))
-                            output.push_back(vec->at(j));
+            // set table used by to_sequence_positions
+            void set_sequence_starts(std::span<const position_t> sequence_starts)
+            {
+                _sequence_starts = sequence_starts;
+            }
+
+            // valid positions as (sequence id, offset inside that sequence), sorted
+            std::vector<std::pair<size_t, position_t>> to_sequence_positions() const
+            {
+                auto positions = to_vector();
 
-                std::sort(output.begin(), output.end());
+                std::vector<std::pair<size_t, position_t>> output;
+                output.reserve(positions.size());
+
+                // positions are sorted, so the sequence id only ever moves forward
+                size_t id = 0;
+                for (position_t pos : positions)
+                {
+                    while (id + 1 < _sequence_starts.size() and _sequence_starts[id + 1] <= pos)
+                        ++id;
+
+                    output.emplace_back(id, pos - (_sequence_starts.empty() ? 0 : _sequence_starts[id]));
+                }
 
                 return output;
             }
 
-            kmer_index_result_iterator begin()
+            // the result is a bidirectional range of its valid positions whose sentinel is the end iterator,
+            // so it composes with std::views without copying the positions (c.f. [3])
+            using iterator = kmer_index_result_iterator;
+
+            kmer_index_result_iterator begin() const
             {
                 return kmer_index_result_iterator(this, true); // set to beginning
             }
 
-            kmer_index_result_iterator end()
+            kmer_index_result_iterator end() const
             {
                 return kmer_index_result_iterator(this, false); // set to end
             }
 
     };
+
+    static_assert(std::ranges::bidirectional_range<kmer_index_result<uint32_t>>
+                  and std::ranges::viewable_range<kmer_index_result<uint32_t>>);
 } // end of namespace kmer::detail
 
 // ###################################
@@ -290,3 +421,32 @@ namespace kmer::detail
 
 
 
+
+// ###################################
+//
+// [2]
+//
+// The iterator visits the valid positions of all spans in the order they are stored. Instead of testing one bit
+// after another, the next valid index is found by scanning the bitmask a 64-bit word at a time: the bits below the
+// current index are masked off and std::countr_zero of the first nonzero word gives the next set bit, so runs of
+// 64 invalid candidates cost one comparison and iterating a sparse result costs time proportional to the number
+// of hits plus the number of words. Backwards iteration does the same with std::countl_zero. Results that bypass
+// the bitmask are valid everywhere and skip the scan. Alongside the index the iterator keeps the span and the
+// offset inside it of the current position, so dereferencing is a single load and advancing walks over the spans
+// in between without searching them.
+//
+// ###################################
+
+// ###################################
+//
+// [3]
+//
+// kmer_index_result models std::ranges::bidirectional_range, begin() and end() are const and the end iterator
+// is its own sentinel. Positions are produced lazily while iterating, in the order they are stored, so a
+// pipeline such as search(query) | std::views::filter(...) | std::views::take(n) only visits positions until n
+// of them passed the filter and never allocates, unlike to_vector(), which collects and sorts all of them
+// (c.f. intersection.hpp [2]). Because results are movable, a temporary result can be piped as well, std::views
+// then takes ownership of it. Each dereference is a single load and each step skips invalid positions a word at
+// a time (c.f. [2]).
+//
+// ###################################
@@ -0,0 +1,382 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <seqan3/alphabet/concept.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <serialization.hpp>
+
+namespace kmer::detail
+{
+    // text stored as ranks with the minimal number of bits per character, used to verify candidates
+    // and as a compact random access range of alphabet_t during construction
+    template<seqan3::alphabet alphabet_t>
+    class packed_text
+    {
+        private:
+            constexpr static size_t _sigma = seqan3::alphabet_size<alphabet_t>;
+            constexpr static size_t _bits_per_char = std::max<size_t>(std::bit_width(_sigma - 1), 1);
+            constexpr static size_t _chars_per_word = 64 / _bits_per_char;
+            constexpr static uint64_t _char_mask = (uint64_t(1) << _bits_per_char) - 1;
+
+            // characters never cross word boundaries
+            flat_array<uint64_t> _words;
+            size_t _size = 0;
+
+            // reverse the order of the characters of a word, only if characters never cross words
+            static uint64_t reverse_characters(uint64_t word)
+            {
+                word = __builtin_bswap64(word);
+
+                if constexpr (_bits_per_char <= 4)
+                    word = ((word >> 4) & 0x0F0F0F0F0F0F0F0F) | ((word & 0x0F0F0F0F0F0F0F0F) << 4);
+
+                if constexpr (_bits_per_char <= 2)
+                    word = ((word >> 2) & 0x3333333333333333) | ((word & 0x3333333333333333) << 2);
+
+                if constexpr (_bits_per_char <= 1)
+                    word = ((word >> 1) & 0x5555555555555555) | ((word & 0x5555555555555555) << 1);
+
+                return word;
+            }
+
+        public:
+            // random access iterator handing out characters by value
+            class iterator
+            {
+                private:
+                    const packed_text* _text = nullptr;
+                    std::ptrdiff_t _i = 0;
+
+                public:
+                    using iterator_concept = std::random_access_iterator_tag;
+                    using iterator_category = std::input_iterator_tag;
+                    using value_type = alphabet_t;
+                    using difference_type = std::ptrdiff_t;
+                    using reference = alphabet_t;
+
+                    iterator() = default;
+
+                    iterator(const packed_text* text, std::ptrdiff_t i)
+                        : _text(text), _i(i)
+                    {}
+
+                    alphabet_t operator*() const
+                    {
+                        return (*_text)[_i];
+                    }
+
+                    alphabet_t operator[](difference_type n) const
+                    {
+                        return (*_text)[_i + n];
+                    }
+
+                    iterator& operator++()
+                    {
+                        ++_i;
+                        return *this;
+                    }
+
+                    iterator operator++(int)
+                    {
+                        auto out = *this;
+                        ++_i;
+                        return out;
+                    }
+
+                    iterator& operator--()
+                    {
+                        --_i;
+                        return *this;
+                    }
+
+                    iterator operator--(int)
+                    {
+                        auto out = *this;
+                        --_i;
+                        return out;
+                    }
+
+                    iterator& operator+=(difference_type n)
+                    {
+                        _i += n;
+                        return *this;
+                    }
+
+                    iterator& operator-=(difference_type n)
+                    {
+                        _i -= n;
+                        return *this;
+                    }
+
+                    friend iterator operator+(iterator it, difference_type n)
+                    {
+                        return it += n;
+                    }
+
+                    friend iterator operator+(difference_type n, iterator it)
+                    {
+                        return it += n;
+                    }
+
+                    friend iterator operator-(iterator it, difference_type n)
+                    {
+                        return it -= n;
+                    }
+
+                    friend difference_type operator-(const iterator& a, const iterator& b)
+                    {
+                        return a._i - b._i;
+                    }
+
+                    friend bool operator==(const iterator& a, const iterator& b)
+                    {
+                        return a._i == b._i;
+                    }
+
+                    friend std::strong_ordering operator<=>(const iterator& a, const iterator& b)
+                    {
+                        return a._i <=> b._i;
+                    }
+            };
+
+            // CTORs
+            packed_text() = default;
+
+            template<std::ranges::range text_t>
+            explicit packed_text(const text_t& text)
+            {
+                for (auto c : text)
+                    push_back(c);
+            }
+
+            // append character, used to build the text chunk by chunk
+            void push_back(alphabet_t c)
+            {
+                size_t shift = (_size % _chars_per_word) * _bits_per_char;
+                if (shift == 0)
+                    _words.push_back(0);
+
+                _words[_words.size() - 1] |= uint64_t(seqan3::to_rank(c)) << shift;
+                ++_size;
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+
+            // rank of ith character
+            uint8_t rank_at(size_t i) const
+            {
+                return (_words[i / _chars_per_word] >> ((i % _chars_per_word) * _bits_per_char)) & _char_mask;
+            }
+
+            // ranks of the size characters starting at pos concatenated with the first character in the most
+            // significant bits, characters past the end have rank 0, size * bits per character <= 64
+            // the first character of a word is in its lowest bits, so the window is the word of pos shifted right,
+            // completed by the next word, with the order of its characters reversed by a byte swap followed by
+            // swapping nibbles, pairs and bits. for sigma = 2^b this is the hash of the window in base sigma
+            uint64_t window(size_t pos, size_t size) const
+            {
+                assert(size * _bits_per_char <= 64);
+
+                if (size == 0)
+                    return 0;
+
+                if constexpr (64 % _bits_per_char == 0)
+                {
+                    size_t word_i = pos / _chars_per_word;
+                    size_t shift = (pos % _chars_per_word) * _bits_per_char;
+
+                    // character j of the window is at bits [j * b, (j + 1) * b), unused bits of the last word are 0
+                    uint64_t out = word_i < _words.size() ? _words[word_i] >> shift : 0;
+                    if (shift > 0 and word_i + 1 < _words.size())
+                        out |= _words[word_i + 1] << (64 - shift);
+
+                    return reverse_characters(out) >> (64 - size * _bits_per_char);
+                }
+                else
+                {
+                    uint64_t out = 0;
+                    for (size_t i = pos; i < pos + size; ++i)
+                        out = (out << _bits_per_char) | (i < _size ? rank_at(i) : 0);
+
+                    return out;
+                }
+            }
+
+            alphabet_t operator[](size_t i) const
+            {
+                return alphabet_t{}.assign_rank(rank_at(i));
+            }
+
+            iterator begin() const
+            {
+                return iterator(this, 0);
+            }
+
+            iterator end() const
+            {
+                return iterator(this, _size);
+            }
+
+            // does the text at pos start with [query_begin, query_begin + size)
+            template<typename iterator_t>
+            bool matches(size_t pos, iterator_t query_begin, size_t size) const
+            {
+                if (pos + size > _size)
+                    return false;
+
+                for (size_t i = 0; i < size; ++i, ++query_begin)
+                    if (rank_at(pos + i) != seqan3::to_rank(*query_begin))
+                        return false;
+
+                return true;
+            }
+
+            // number of mismatches between the text at pos and [query_begin, query_begin + size),
+            // stops counting once max_mismatches is exceeded
+            template<typename iterator_t>
+            size_t mismatches(size_t pos, iterator_t query_begin, size_t size, size_t max_mismatches) const
+            {
+                assert(pos + size <= _size);
+
+                size_t n = 0;
+                for (size_t i = 0; i < size and n <= max_mismatches; ++i, ++query_begin)
+                    n += rank_at(pos + i) != seqan3::to_rank(*query_begin);
+
+                return n;
+            }
+
+            size_t n_bytes() const
+            {
+                return _words.size() * sizeof(uint64_t);
+            }
+
+            void save(binary_writer& out) const
+            {
+                out.write_value<uint64_t>(_size);
+                out.write_array(_words.view());
+            }
+
+            // words stay a view into the mapped file
+            void load(binary_reader& in)
+            {
+                _size = in.read_value<uint64_t>();
+                _words = flat_array<uint64_t>(in.read_array<uint64_t>());
+            }
+    };
+
+    // ranks of a query packed into one bit string, first character in the most significant bits, so that the hash
+    // of any window of the query can be extracted in constant time if sigma is a power of two (c.f. [1])
+    template<seqan3::alphabet alphabet_t>
+    class packed_query
+    {
+        private:
+            constexpr static size_t _sigma = seqan3::alphabet_size<alphabet_t>;
+            constexpr static size_t _bits_per_char = std::max<size_t>(std::bit_width(_sigma - 1), 1);
+            constexpr static size_t _n_inline_words = 8;
+
+            // queries up to 8 * 64 bits do not allocate
+            std::array<uint64_t, _n_inline_words> _inline_words;
+            std::vector<uint64_t> _heap_words;
+            uint64_t* _words = _inline_words.data();
+
+        public:
+            // hashes are only the concatenated ranks if sigma is a power of two
+            constexpr static bool is_supported = std::has_single_bit(_sigma);
+
+            // longest window whose hash fits into 64 bit
+            constexpr static size_t max_window_size = 63 / _bits_per_char;
+
+            // CTOR
+            template<typename iterator_t>
+            packed_query(iterator_t query_begin, size_t size)
+            {
+                size_t n_words = (size * _bits_per_char) / 64 + 2;
+
+                if (n_words > _n_inline_words)
+                {
+                    _heap_words.assign(n_words, 0);
+                    _words = _heap_words.data();
+                }
+                else
+                    std::fill(_inline_words.begin(), _inline_words.end(), 0);
+
+                if constexpr (64 % _bits_per_char == 0)
+                {
+                    // characters never cross words, all characters of a word are independent so this vectorizes
+                    constexpr size_t chars_per_word = 64 / _bits_per_char;
+
+                    for (size_t word_i = 0; word_i * chars_per_word < size; ++word_i)
+                    {
+                        size_t n = std::min(chars_per_word, size - word_i * chars_per_word);
+
+                        uint64_t word = 0;
+                        for (size_t i = 0; i < n; ++i)
+                            word |= uint64_t(seqan3::to_rank(query_begin[word_i * chars_per_word + i]))
+                                    << (64 - _bits_per_char * (i + 1));
+
+                        _words[word_i] = word;
+                    }
+                }
+                else
+                {
+                    for (size_t i = 0; i < size; ++i)
+                    {
+                        uint64_t rank = seqan3::to_rank(query_begin[i]);
+                        size_t bit = i * _bits_per_char;
+                        size_t shift = bit & 63;
+
+                        if (shift + _bits_per_char <= 64)
+                            _words[bit >> 6] |= rank << (64 - _bits_per_char - shift);
+                        else
+                        {
+                            size_t n_overflow = shift + _bits_per_char - 64;
+                            _words[bit >> 6] |= rank >> n_overflow;
+                            _words[(bit >> 6) + 1] |= rank << (64 - n_overflow);
+                        }
+                    }
+                }
+            }
+
+            packed_query(const packed_query&) = delete;
+            packed_query& operator=(const packed_query&) = delete;
+
+            // hash of the size characters starting at offset, size <= max_window_size
+            uint64_t hash(size_t offset, size_t size) const
+            {
+                if (size == 0)
+                    return 0;
+
+                size_t bit = offset * _bits_per_char;
+                size_t n_bits = size * _bits_per_char;
+
+                // window is inside the 128 bits starting at the word of its first character
+                unsigned __int128 both = (static_cast<unsigned __int128>(_words[bit >> 6]) << 64) | _words[(bit >> 6) + 1];
+                return static_cast<uint64_t>(both >> (128 - (bit & 63) - n_bits)) & ((uint64_t(1) << n_bits) - 1);
+            }
+    };
+} // end of namespace kmer::detail
+
+// ###################################
+//
+// [1]
+//
+// For an alphabet of size sigma = 2^b the hash of a kmer, sum rank_i * sigma^(k - 1 - i), is exactly the
+// concatenation of the b-bit ranks. packed_query packs all ranks of a query once in O(m), after which the hash
+// of any window, be it one of the non-overlapping blocks searched by a kmer_index_element, a prefix or an
+// overlapping window, is two shifts and a mask. For window sizes that do not divide 64 the window may start
+// in one word and end in the next, so the two words are read as one 128-bit integer.
+//
+// ###################################
@@ -0,0 +1,332 @@
+// Copyright (c) 2020 Clemens Cords. All rights reserved.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kmer::detail
+{
+    // allocator whose memory starts at a multiple of alignment bytes, e.g. 64 for the start of a cache line
+    template<typename T, size_t alignment>
+    struct aligned_allocator
+    {
+        static_assert(alignment >= alignof(T) and (alignment & (alignment - 1)) == 0,
+                      "alignment has to be a power of two and at least the alignment of T");
+
+        using value_type = T;
+
+        template<typename U>
+        struct rebind
+        {
+            using other = aligned_allocator<U, alignment>;
+        };
+
+        aligned_allocator() = default;
+
+        template<typename U>
+        aligned_allocator(const aligned_allocator<U, alignment>&)
+        {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment)));
+        }
+
+        void deallocate(T* ptr, size_t)
+        {
+            ::operator delete(ptr, std::align_val_t(alignment));
+        }
+
+        template<typename U>
+        bool operator==(const aligned_allocator<U, alignment>&) const
+        {
+            return true;
+        }
+    };
+
+    // contiguous array that either owns its memory or is a view of memory owned by someone else,
+    // for example the pages of a memory mapped index file
+    template<typename T, typename allocator_t = std::allocator<T>>
+    class flat_array
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "flat_array can only hold trivially copyable types");
+
+        private:
+            std::vector<T, allocator_t> _owned;
+            const T* _data = nullptr;
+            size_t _size = 0;
+
+        public:
+            // CTORs
+            flat_array() = default;
+
+            flat_array(std::vector<T, allocator_t>&& owned)
+                : _owned(std::move(owned)), _data(_owned.data()), _size(_owned.size())
+            {}
+
+            flat_array(std::span<const T> view)
+                : _data(view.data()), _size(view.size())
+            {}
+
+            flat_array(const flat_array& other)
+                : _owned(other._owned), _data(other.is_owned() ? _owned.data() : other._data), _size(other._size)
+            {}
+
+            flat_array(flat_array&& other) noexcept
+                : _owned(std::move(other._owned)), _data(other._data), _size(other._size)
+            {
+                other._data = nullptr;
+                other._size = 0;
+            }
+
+            flat_array& operator=(flat_array other) noexcept
+            {
+                std::swap(_owned, other._owned);
+                std::swap(_data, other._data);
+                std::swap(_size, other._size);
+                return *this;
+            }
+
+            bool is_owned() const
+            {
+                return _data != nullptr and _data == _owned.data();
+            }
+
+            const T& operator[](size_t i) const
+            {
+                return _data[i];
+            }
+
+            // write access, only available while the memory is owned
+            T& operator[](size_t i)
+            {
+                assert(is_owned());
+                return _owned[i];
+            }
+
+            // append, only available while the memory is owned or the array is empty
+            void push_back(const T& value)
+            {
+                assert(is_owned() or _size == 0);
+                _owned.push_back(value);
+                _data = _owned.data();
+                _size = _owned.size();
+            }
+
+            const T* data() const
+            {
+                return _data;
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+
+            bool empty() const
+            {
+                return _size == 0;
+            }
+
+            const T* begin() const
+            {
+                return _data;
+            }
+
+            const T* end() const
+            {
+                return _data + _size;
+            }
+
+            std::span<const T> view() const
+            {
+                return std::span<const T>(_data, _size);
+            }
+    };
+
+    // read-only memory mapping of a file, unmapped on destruction
+    class mapped_file
+    {
+        private:
+            void* _data = nullptr;
+            size_t _size = 0;
+
+        public:
+            explicit mapped_file(const std::string& path)
+            {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    throw std::runtime_error("unable to open " + path);
+
+                struct stat info;
+                if (::fstat(fd, &info) != 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("unable to stat " + path);
+                }
+
+                _size = info.st_size;
+                _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (_data == MAP_FAILED)
+                    throw std::runtime_error("unable to map " + path);
+            }
+
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            ~mapped_file()
+            {
+                if (_data != nullptr and _data != MAP_FAILED)
+                    ::munmap(_data, _size);
+            }
+
+            const std::byte* data() const
+            {
+                return static_cast<const std::byte*>(_data);
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+    };
+
+    // arrays inside the file are aligned to this many bytes so they can be used in place
+    constexpr size_t _file_alignment = 64;
+
+    // sequential writer for the binary index format (c.f. [1])
+    class binary_writer
+    {
+        private:
+            std::ofstream _out;
+            size_t _n_written = 0;
+
+            void pad()
+            {
+                static const char zeros[_file_alignment] = {};
+                size_t n = (_file_alignment - _n_written % _file_alignment) % _file_alignment;
+                _out.write(zeros, n);
+                _n_written += n;
+            }
+
+        public:
+            explicit binary_writer(const std::string& path)
+                : _out(path, std::ios::binary | std::ios::trunc)
+            {
+                if (not _out)
+                    throw std::runtime_error("unable to open " + path + " for writing");
+            }
+
+            template<typename T>
+            void write_value(T value)
+            {
+                static_assert(std::is_trivially_copyable_v<T>);
+                _out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+                _n_written += sizeof(T);
+            }
+
+            // writes size, then the aligned elements
+            template<typename T>
+            void write_array(std::span<const T> array)
+            {
+                static_assert(std::is_trivially_copyable_v<T>);
+                write_value<uint64_t>(array.size());
+                pad();
+                _out.write(reinterpret_cast<const char*>(array.data()), array.size_bytes());
+                _n_written += array.size_bytes();
+            }
+
+            void finish()
+            {
+                _out.flush();
+                if (not _out)
+                    throw std::runtime_error("error while writing index file");
+            }
+    };
+
+    // sequential reader for the binary index format, arrays are returned as views into the mapping
+    class binary_reader
+    {
+        private:
+            std::shared_ptr<const mapped_file> _file;
+            size_t _n_read = 0;
+
+            // number of bytes after the read position, the alignment padding may already have passed the end
+            size_t n_left() const
+            {
+                return _n_read <= _file->size() ? _file->size() - _n_read : 0;
+            }
+
+            // compared without adding to _n_read, so sizes read from a corrupted file cannot overflow
+            void require(size_t n) const
+            {
+                if (n > n_left())
+                    throw std::invalid_argument("index file is truncated");
+            }
+
+        public:
+            explicit binary_reader(std::shared_ptr<const mapped_file> file)
+                : _file(std::move(file))
+            {}
+
+            template<typename T>
+            T read_value()
+            {
+                static_assert(std::is_trivially_copyable_v<T>);
+                require(sizeof(T));
+
+                T out;
+                std::memcpy(&out, _file->data() + _n_read, sizeof(T));
+                _n_read += sizeof(T);
+                return out;
+            }
+
+            template<typename T>
+            std::span<const T> read_array()
+            {
+                static_assert(std::is_trivially_copyable_v<T>);
+                size_t size = read_value<uint64_t>();
+
+                _n_read += (_file_alignment - _n_read % _file_alignment) % _file_alignment;
+
+                // checked before multiplying, size * sizeof(T) may overflow
+                if (size > n_left() / sizeof(T))
+                    throw std::invalid_argument("index file is truncated");
+
+                auto* begin = reinterpret_cast<const T*>(_file->data() + _n_read);
+                _n_read += size * sizeof(T);
+
+                return std::span<const T>(begin, size);
+            }
+    };
+} // end of namespace kmer::detail
+
+// ###################################
+//
+// [1]
+//
+// The index file consists of plain values and arrays written in a fixed order. Each array is prefixed by its
+// number of elements and starts at an offset that is a multiple of 64 bytes. Because mmap returns page aligned
+// memory, every array inside a mapped file is correctly aligned for its element type, so the index can search
+// directly on the mapped pages through flat_array views without copying or parsing anything. The format uses
+// native byte order and primitive sizes, the header stores a byte order mark and the sizes used so mismatching
+// files are rejected instead of misread.
+//
+// ###################################
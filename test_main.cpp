@@ -6,10 +6,14 @@
 #include <seqan3/alphabet/all.hpp>
 
 #include <kmer_index.hpp>
+#include <kmer_index_builder.hpp>
 #include <benchmarks/input_generator.hpp>
 #include <seqan3/search/fm_index/fm_index.hpp>
 #include <seqan3/search/search.hpp>
 
+#include <filesystem>
+#include <fstream>
+
 using alphabet_1 = seqan3::dna4;
 using alphabet_2 = seqan3::dna15;
 
@@ -18,6 +22,275 @@ constexpr size_t text_size = 1000000;
 
 static size_t seed = 0;
 
+// file in the temporary directory that is removed at the end of the scope
+struct temporary_file
+{
+    std::string path;
+
+    explicit temporary_file(const std::string& name)
+        : path((std::filesystem::temp_directory_path() / name).string())
+    {}
+
+    temporary_file(const temporary_file&) = delete;
+    temporary_file& operator=(const temporary_file&) = delete;
+
+    ~temporary_file()
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+};
+
+// all positions of query in text by comparing every window
+template<typename text_t, typename query_t>
+std::vector<unsigned int> naive_search(const text_t& text, const query_t& query)
+{
+    std::vector<unsigned int> out;
+    for (size_t i = 0; i + query.size() <= text.size(); ++i)
+        if (std::equal(query.begin(), query.end(), text.begin() + i))
+            out.push_back(i);
+
+    return out;
+}
+
+// all positions where query occurs in text with at most max_errors substitutions
+template<typename text_t, typename query_t>
+std::vector<unsigned int> naive_search_approximate(const text_t& text, const query_t& query, size_t max_errors)
+{
+    std::vector<unsigned int> out;
+    for (size_t i = 0; i + query.size() <= text.size(); ++i)
+    {
+        size_t n_errors = 0;
+        for (size_t j = 0; j < query.size() and n_errors <= max_errors; ++j)
+            n_errors += not (text[i + j] == query[j]);
+
+        if (n_errors <= max_errors)
+            out.push_back(i);
+    }
+
+    return out;
+}
+
+// sorted union of the results of both strands
+std::vector<unsigned int> merge_strands(std::vector<unsigned int> forward, const std::vector<unsigned int>& reverse)
+{
+    forward.insert(forward.end(), reverse.begin(), reverse.end());
+    std::sort(forward.begin(), forward.end());
+    forward.erase(std::unique(forward.begin(), forward.end()), forward.end());
+    return forward;
+}
+
+template<typename alphabet_t>
+std::vector<alphabet_t> reverse_complement(const std::vector<alphabet_t>& query)
+{
+    std::vector<alphabet_t> out;
+    for (auto it = query.rbegin(); it != query.rend(); ++it)
+        out.push_back(seqan3::complement(*it));
+
+    return out;
+}
+
+// exit with a message if the results of name differ from the expected ones
+void check_equal(const std::vector<unsigned int>& expected, const std::vector<unsigned int>& result, const std::string& name)
+{
+    if (expected == result)
+        return;
+
+    seqan3::debug_stream << "NOT EQUAL FOR " << name << "\nexpected " << expected.size() << " results, got "
+                         << result.size() << "\nseed = " << seed << "\n";
+    exit(1);
+}
+
+// exit with a message if the count of name differs from the number of expected results
+void check_count(const std::vector<unsigned int>& expected, size_t count, const std::string& name)
+{
+    if (expected.size() == count)
+        return;
+
+    seqan3::debug_stream << "NOT EQUAL FOR " << name << "\nexpected " << expected.size() << " results, got "
+                         << count << "\nseed = " << seed << "\n";
+    exit(1);
+}
+
+// a query of query_size characters, every other query size is cut out of text so that it occurs at least once
+template<typename alphabet_t>
+std::vector<alphabet_t> sample_query(input_generator<alphabet_t>& input, const std::vector<alphabet_t>& text, size_t query_size)
+{
+    if (query_size % 2 == 1)
+        return input.generate_sequence(query_size);
+
+    size_t offset = (query_size * 997) % (text.size() - query_size);
+    return std::vector<alphabet_t>(text.begin() + offset, text.begin() + offset + query_size);
+}
+
+// the target of a successor search in an elias fano list can lie beyond its last bucket
+void run_elias_fano_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    std::vector<alphabet_t> text(4000, seqan3::assign_char_to('A', alphabet_t{}));
+    for (size_t i = 0; i < text.size(); i += 7)
+        text[i] = seqan3::assign_char_to('T', alphabet_t{});
+
+    text[3990] = seqan3::assign_char_to('G', alphabet_t{});
+
+    std::vector<alphabet_t> query(1200, seqan3::assign_char_to('A', alphabet_t{}));
+    query.front() = seqan3::assign_char_to('G', alphabet_t{});
+    query.back() = seqan3::assign_char_to('T', alphabet_t{});
+
+    auto encoded_kmer = kmer::make_kmer_index<k_0>(text, 1, {.encoding = kmer::POSITION_ENCODING::ELIAS_FANO});
+    auto expected = naive_search(text, query);
+
+    check_equal(expected, encoded_kmer.search(query).to_vector(), "elias fano search");
+
+    check_count(expected, encoded_kmer.count(query), "elias fano count");
+
+    // the hashspace of k = 12 is too large to be addressed directly, the positions of its keys are encoded
+    auto sparse_kmer = kmer::make_kmer_index<12>(text, 1, {.encoding = kmer::POSITION_ENCODING::ELIAS_FANO});
+
+    auto index_file = temporary_file("test_index.bin");
+    sparse_kmer.save(index_file.path);
+    auto loaded_kmer = decltype(sparse_kmer)::load(index_file.path);
+
+    for (size_t query_size : {5, 12, 30, 200})
+    {
+        auto sparse_query = std::vector<alphabet_t>(text.begin() + 100, text.begin() + 100 + query_size);
+        auto sparse_expected = naive_search(text, sparse_query);
+
+        check_equal(sparse_expected, sparse_kmer.search(sparse_query).to_vector(), "sparse elias fano search");
+        check_equal(sparse_expected, loaded_kmer.search(sparse_query).to_vector(), "loaded sparse elias fano search");
+        check_count(sparse_expected, sparse_kmer.count(sparse_query), "sparse elias fano count");
+    }
+}
+
+// array sizes of a corrupted file are rejected even if their size in bytes overflows
+void run_corrupted_file_test()
+{
+    auto input = input_generator<seqan3::dna4>(seed++);
+    auto text = input.generate_sequence(1000);
+    auto kmer = kmer::make_kmer_index<5>(text, 1);
+
+    auto index_file = temporary_file("test_corrupted_index.bin");
+    kmer.save(index_file.path);
+
+    // the array of ks follows the magic, version, byte order mark, alphabet size and position size
+    {
+        auto file = std::fstream(index_file.path, std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t size = (uint64_t(1) << 61) + 1;
+        file.seekp(24);
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    }
+
+    bool thrown = false;
+    try { decltype(kmer)::load(index_file.path); }
+    catch (std::invalid_argument&) { thrown = true; }
+
+    if (not thrown)
+    {
+        seqan3::debug_stream << "NO EXCEPTION FOR corrupted array size\n";
+        exit(1);
+    }
+}
+
+// the larger ks only store minimizers, queries of every size up to well past the largest window are compared, so
+// both the lookups of the smallest k and the verified candidates of minimizers are covered
+void run_minimizer_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        // queries of size 12 and 16 contain a full window of k = 9 and 13, k = 13 is sparse
+        auto minimizer_kmer = kmer::make_kmer_index<5, 9, 13>(text, 4, {.minimizer_window = 4});
+
+        auto index_file = temporary_file("test_minimizer_index.bin");
+        minimizer_kmer.save(index_file.path);
+        auto loaded_kmer = decltype(minimizer_kmer)::load(index_file.path);
+        auto context = decltype(minimizer_kmer)::search_context();
+
+        std::vector<std::vector<alphabet_t>> queries;
+        for (size_t query_size = 1; query_size < 40; ++query_size)
+            queries.push_back(sample_query(input, text, query_size));
+
+        auto batch_results = minimizer_kmer.search_batch(queries);
+        auto parallel_results = minimizer_kmer.search_parallel(queries, 4);
+
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            auto& query = queries[j];
+            auto expected = naive_search(text, query);
+
+            check_equal(expected, minimizer_kmer.search(query).to_vector(), "minimizer search");
+            check_equal(expected, loaded_kmer.search(query).to_vector(), "loaded minimizer search");
+            check_count(expected, minimizer_kmer.count(query), "minimizer count");
+            check_equal(expected, batch_results[j].to_vector(), "minimizer search_batch");
+            check_equal(expected, parallel_results[j].to_vector(), "minimizer search_parallel");
+
+            auto context_result = minimizer_kmer.search(query, context);
+            check_equal(expected, std::vector<unsigned int>(context_result.begin(), context_result.end()),
+                        "minimizer context search");
+        }
+    }
+}
+
+// shape of weight k that skips every third character, starting with the second to last
+constexpr uint64_t spaced_shape(size_t k)
+{
+    uint64_t shape = 0;
+    for (size_t bit = 0, weight = 0; weight < k; ++bit)
+    {
+        if (bit % 3 != 1)
+        {
+            shape |= uint64_t(1) << bit;
+            ++weight;
+        }
+    }
+
+    return shape;
+}
+
+// shared and elias fano positions, a saved and loaded index, a search_context and count answer like a plain index
+template<seqan3::alphabet alphabet_t, size_t k>
+void run_encoding_test()
+{
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        auto multi_kmer = kmer::make_kmer_index<k, k+1, k+2>(text);
+        auto shared_kmer = kmer::make_kmer_index<k, k+1, k+2>(text, std::thread::hardware_concurrency(),
+                                                              {.encoding = kmer::POSITION_ENCODING::SHARED});
+        auto encoded_kmer = kmer::make_kmer_index<k>(text, std::thread::hardware_concurrency(),
+                                                     {.encoding = kmer::POSITION_ENCODING::ELIAS_FANO});
+
+        auto index_file = temporary_file("test_index.bin");
+        multi_kmer.save(index_file.path);
+        auto loaded_kmer = decltype(multi_kmer)::load(index_file.path);
+
+        auto context = typename decltype(multi_kmer)::search_context();
+
+        for (size_t query_size = 1; query_size < 2*k + 5; query_size++)
+        {
+            auto query = sample_query(input, text, query_size);
+            auto expected = naive_search(text, query);
+
+            check_equal(expected, shared_kmer.search(query).to_vector(), "shared search");
+            check_equal(expected, encoded_kmer.search(query).to_vector(), "encoded search");
+            check_equal(expected, loaded_kmer.search(query).to_vector(), "loaded search");
+            check_count(expected, multi_kmer.count(query), "count");
+            check_count(expected, encoded_kmer.count(query, context), "count with context");
+
+            auto context_result = multi_kmer.search(query, context);
+            check_equal(expected, std::vector<unsigned int>(context_result.begin(), context_result.end()),
+                        "context search");
+        }
+    }
+}
+
 template<seqan3::alphabet alphabet_t, size_t k>
 void run_test()
 {
@@ -68,11 +341,705 @@ void run_test()
     return;
 }
 
+// exact and approximate search find both strands with canonical kmers, also for queries shorter than k
+void run_canonical_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+        auto canonical_kmer = kmer::make_kmer_index<5, 6>(text, 1, {.orientation = kmer::ORIENTATION::CANONICAL});
+
+        // the orientation and the text are stored in the file
+        auto index_file = temporary_file("test_index.bin");
+        canonical_kmer.save(index_file.path);
+        auto loaded_kmer = decltype(canonical_kmer)::load(index_file.path);
+
+        std::vector<std::vector<alphabet_t>> queries;
+        for (size_t query_size = 2; query_size < 32; query_size++)
+            queries.push_back(sample_query(input, text, query_size));
+
+        auto batch_results = canonical_kmer.search_batch(queries);
+        decltype(canonical_kmer)::search_context context;
+
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            auto& query = queries[j];
+            size_t query_size = query.size();
+            auto reverse = reverse_complement(query);
+
+            auto expected = merge_strands(naive_search(text, query), naive_search(text, reverse));
+            check_equal(expected, canonical_kmer.search(query).to_vector(), "canonical search");
+            check_equal(expected, loaded_kmer.search(query).to_vector(), "loaded canonical search");
+            check_equal(expected, batch_results[j].to_vector(), "canonical search_batch");
+            check_count(expected, canonical_kmer.count(query), "canonical count");
+
+            auto context_result = canonical_kmer.search(query, context);
+            check_equal(expected, std::vector<unsigned int>(context_result.begin(), context_result.end()),
+                        "canonical context search");
+
+            for (size_t max_errors = 1; max_errors <= 3 and max_errors < query_size; ++max_errors)
+            {
+                expected = merge_strands(naive_search_approximate(text, query, max_errors),
+                                         naive_search_approximate(text, reverse, max_errors));
+                check_equal(expected, canonical_kmer.search_approximate(query, max_errors).to_vector(),
+                            "canonical approximate search");
+                check_equal(expected, loaded_kmer.search_approximate(query, max_errors).to_vector(),
+                            "loaded canonical approximate search");
+            }
+        }
+
+        // queries shorter than k near the ends of sequences, k = 12 is sparse, so short queries look up the ranges
+        // of keys with the query as prefix and with its reverse complement as suffix
+        std::vector<std::vector<alphabet_t>> collection;
+        for (size_t size : {text_size / 50, size_t(3), text_size / 100})
+            collection.push_back(input.generate_sequence(size));
+
+        auto sparse_kmer = kmer::make_kmer_index<12>(collection, 1, {.orientation = kmer::ORIENTATION::CANONICAL});
+
+        auto sparse_file = temporary_file("test_sparse_canonical_index.bin");
+        sparse_kmer.save(sparse_file.path);
+        auto loaded_sparse_kmer = decltype(sparse_kmer)::load(sparse_file.path);
+
+        for (size_t query_size = 2; query_size < 20; query_size++)
+        {
+            auto query = sample_query(input, collection[0], query_size);
+            auto reverse = reverse_complement(query);
+
+            std::vector<unsigned int> expected;
+            size_t start = 0;
+            for (auto& sequence : collection)
+            {
+                for (unsigned int pos : merge_strands(naive_search(sequence, query), naive_search(sequence, reverse)))
+                    expected.push_back(start + pos);
+
+                start += sequence.size() + 1;
+            }
+
+            check_equal(expected, sparse_kmer.search(query).to_vector(), "sparse canonical collection search");
+            check_count(expected, sparse_kmer.count(query), "sparse canonical collection count");
+            check_equal(expected, loaded_sparse_kmer.search(query).to_vector(), "loaded sparse canonical collection search");
+        }
+    }
+}
+
+// kmers that do not fit into 64 bit are hashed into 128 or 256 bit integers
+template<size_t k>
+void run_wide_hash_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        // repeat a part of the text so that buckets hold more than one position
+        std::copy(text.begin(), text.begin() + text.size() / 10, text.begin() + text.size() / 2);
+
+        auto wide_kmer = kmer::make_kmer_index<k, k+3>(text, 1);
+
+        for (size_t query_size = k-2; query_size < 2*k + 3; query_size++)
+        {
+            auto query = sample_query(input, text, query_size);
+            auto expected = naive_search(text, query);
+
+            check_equal(expected, wide_kmer.search(query).to_vector(), "wide hash search, k = " + std::to_string(k));
+            check_count(expected, wide_kmer.count(query), "wide hash count, k = " + std::to_string(k));
+        }
+    }
+}
+
+// hits in a collection are reported per sequence and never span two sequences
+void run_collection_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+
+        // sequences of varying size, including one shorter than every k
+        std::vector<std::vector<alphabet_t>> collection;
+        for (size_t size : {text_size / 50, size_t(3), text_size / 20, text_size / 100})
+            collection.push_back(input.generate_sequence(size));
+
+        auto collection_kmer = kmer::make_kmer_index<5, 6, 7>(collection, 1);
+
+        // too small to be split into chunks, so the elements are constructed concurrently
+        auto parallel_kmer = kmer::make_kmer_index<5, 6, 7>(collection, 4);
+
+        // only minimizers of windows of 3 kmers
+        auto minimizer_kmer = kmer::make_kmer_index<5, 6, 7>(collection, 4, {.minimizer_window = 3});
+        auto minimizer_file = temporary_file("test_minimizer_index.bin");
+        minimizer_kmer.save(minimizer_file.path);
+        auto loaded_minimizer_kmer = decltype(minimizer_kmer)::load(minimizer_file.path);
+
+        // spaced seeds of span 9 and 10, short queries are looked up by the ungapped k = 5
+        auto spaced_kmer = kmer::make_kmer_index<5, 6, 7>(collection, 4,
+                                                          {.shapes = {0, spaced_shape(6), spaced_shape(7)}});
+        auto spaced_file = temporary_file("test_spaced_index.bin");
+        spaced_kmer.save(spaced_file.path);
+        auto loaded_spaced_kmer = decltype(spaced_kmer)::load(spaced_file.path);
+
+        // the shared positions are written once
+        auto shared_kmer = kmer::make_kmer_index<5, 6, 7>(collection, 4, {.encoding = kmer::POSITION_ENCODING::SHARED});
+        auto index_file = temporary_file("test_index.bin");
+        shared_kmer.save(index_file.path);
+        auto loaded_shared_kmer = decltype(shared_kmer)::load(index_file.path);
+        auto context = decltype(shared_kmer)::search_context();
+
+        for (size_t query_size = 3; query_size < 20; query_size++)
+        {
+            auto query = sample_query(input, collection[2], query_size);
+
+            std::vector<unsigned int> expected;
+            std::vector<std::pair<size_t, unsigned int>> expected_per_sequence;
+
+            size_t start = 0;
+            for (size_t id = 0; id < collection.size(); ++id)
+            {
+                for (unsigned int pos : naive_search(collection[id], query))
+                {
+                    expected.push_back(start + pos);
+                    expected_per_sequence.emplace_back(id, pos);
+                }
+
+                start += collection[id].size() + 1;
+            }
+
+            auto result = collection_kmer.search(query);
+            check_equal(expected, result.to_vector(), "collection search");
+            check_count(expected, collection_kmer.count(query), "collection count");
+            check_equal(expected, parallel_kmer.search(query).to_vector(), "concurrently constructed search");
+            check_equal(expected, shared_kmer.search(query).to_vector(), "shared search");
+            check_equal(expected, loaded_shared_kmer.search(query).to_vector(), "loaded shared search");
+            check_count(expected, shared_kmer.count(query), "shared count");
+            check_equal(expected, minimizer_kmer.search(query).to_vector(), "minimizer search");
+            check_equal(expected, loaded_minimizer_kmer.search(query).to_vector(), "loaded minimizer search");
+            check_count(expected, minimizer_kmer.count(query), "minimizer count");
+            check_equal(expected, spaced_kmer.search(query).to_vector(), "spaced search");
+            check_equal(expected, loaded_spaced_kmer.search(query).to_vector(), "loaded spaced search");
+            check_count(expected, spaced_kmer.count(query), "spaced count");
+
+            auto context_result = shared_kmer.search(query, context);
+            check_equal(expected, std::vector<unsigned int>(context_result.begin(), context_result.end()),
+                        "shared context search");
+
+            if (result.to_sequence_positions() != expected_per_sequence)
+            {
+                seqan3::debug_stream << "NOT EQUAL FOR to_sequence_positions\nseed = " << seed << "\n";
+                exit(1);
+            }
+        }
+    }
+
+    // without an ungapped k, queries shorter than every span are rejected instead of scanning the text
+    auto input = input_generator<seqan3::dna4>(seed++);
+    auto text = input.generate_sequence(1000);
+    auto gapped_kmer = kmer::make_kmer_index<6, 7>(text, 1, {.shapes = {spaced_shape(6), spaced_shape(7)}});
+
+    bool thrown = false;
+    try { gapped_kmer.search(input.generate_sequence(8)); }
+    catch (std::invalid_argument&) { thrown = true; }
+
+    if (not thrown)
+    {
+        seqan3::debug_stream << "NO EXCEPTION FOR query shorter than every span\n";
+        exit(1);
+    }
+}
+
+// a collection appended in chunks or read from a FASTA file is indexed like the collection itself
+void run_builder_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+
+        std::vector<std::vector<alphabet_t>> collection;
+        for (size_t size : {text_size / 50, size_t(3), text_size / 20})
+            collection.push_back(input.generate_sequence(size));
+
+        // chunks of varying size, some of them empty
+        auto builder = kmer::kmer_index_builder<alphabet_t, uint32_t, 5, 6, 7>();
+        for (auto& sequence : collection)
+        {
+            builder.start_sequence();
+            for (size_t begin = 0, chunk_size = 0; begin < sequence.size(); begin += chunk_size, chunk_size = 2 * chunk_size + 1)
+            {
+                size_t end = std::min(begin + chunk_size, sequence.size());
+                builder.append(std::span<alphabet_t>(sequence.data() + begin, end - begin));
+            }
+        }
+
+        auto builder_kmer = builder.finalize(1);
+
+        // records with a header line each and sequences wrapped after 60 characters
+        auto fasta_file = temporary_file("test_collection.fa");
+        {
+            auto file = std::ofstream(fasta_file.path);
+            for (size_t id = 0; id < collection.size(); ++id)
+            {
+                file << ">sequence " << id << " of the test collection\n";
+                for (size_t j = 0; j < collection[id].size(); ++j)
+                    file << seqan3::to_char(collection[id][j]) << (j % 60 == 59 ? "\n" : "");
+
+                file << "\n";
+            }
+        }
+
+        auto fasta_kmer = kmer::make_kmer_index_from_fasta<alphabet_t, 5, 6, 7>(fasta_file.path, 1);
+
+        for (size_t query_size = 3; query_size < 20; query_size++)
+        {
+            auto query = sample_query(input, collection[2], query_size);
+
+            std::vector<unsigned int> expected;
+            size_t start = 0;
+            for (auto& sequence : collection)
+            {
+                for (unsigned int pos : naive_search(sequence, query))
+                    expected.push_back(start + pos);
+
+                start += sequence.size() + 1;
+            }
+
+            check_equal(expected, builder_kmer.search(query).to_vector(), "builder search");
+            check_equal(expected, fasta_kmer.search(query).to_vector(), "fasta search");
+            check_count(expected, fasta_kmer.count(query), "fasta count");
+        }
+    }
+
+    // characters outside of the alphabet are rejected instead of being converted
+    auto invalid_file = temporary_file("test_invalid.fa");
+    std::ofstream(invalid_file.path) << ">sequence with an N\nACGTNACGT\n";
+
+    bool thrown = false;
+    try { kmer::make_kmer_index_from_fasta<alphabet_t, 5>(invalid_file.path, 1); }
+    catch (std::invalid_argument&) { thrown = true; }
+
+    if (not thrown)
+    {
+        seqan3::debug_stream << "NO EXCEPTION FOR invalid character in FASTA file\n";
+        exit(1);
+    }
+}
+
+// many queries searched at once or by multiple threads return the same results as searching them one by one
+void run_batch_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        // k = 4 is addressed directly, k = 10 and 12 are sparse
+        auto batch_kmer = kmer::make_kmer_index<4, 10, 12>(text, 1);
+
+        std::vector<std::vector<alphabet_t>> queries;
+        for (size_t j = 0; j < 1000; ++j)
+            queries.push_back(sample_query(input, text, 2 + (j * 7) % 30));
+
+        std::vector<std::vector<unsigned int>> expected;
+        for (auto& query : queries)
+            expected.push_back(naive_search(text, query));
+
+        auto batch_results = batch_kmer.search_batch(queries);
+        for (size_t j = 0; j < queries.size(); ++j)
+            check_equal(expected[j], batch_results[j].to_vector(), "search_batch");
+
+        // more threads than chunks, repeated calls reusing the pool of the index and a pool of the caller
+        auto pool = kmer::detail::thread_pool(3);
+        for (size_t n_threads : {1, 2, 4, 8})
+        {
+            auto parallel_results = batch_kmer.search_parallel(queries, n_threads);
+            auto pool_results = batch_kmer.search_parallel(queries, pool, n_threads);
+
+            for (size_t j = 0; j < queries.size(); ++j)
+            {
+                check_equal(expected[j], parallel_results[j].to_vector(), "search_parallel, n_threads = " + std::to_string(n_threads));
+                check_equal(expected[j], pool_results[j].to_vector(), "search_parallel with a pool, n_threads = " + std::to_string(n_threads));
+            }
+        }
+    }
+}
+
+// the bloom filter never rejects an inserted key, and an index using it returns the same results
+void run_bloom_filter_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    // keys 0, 2, 4, ... are inserted, the odd keys are absent
+    size_t n_keys = 100000;
+    auto filter = kmer::detail::blocked_bloom_filter(n_keys);
+    for (uint64_t key = 0; key < 2 * n_keys; key += 2)
+        filter.insert(key);
+
+    size_t n_false_positives = 0;
+    for (uint64_t key = 0; key < 2 * n_keys; key += 2)
+    {
+        if (not filter.may_contain(key))
+        {
+            seqan3::debug_stream << "BLOOM FILTER REJECTED INSERTED KEY " << key << "\n";
+            exit(1);
+        }
+
+        n_false_positives += filter.may_contain(key + 1);
+    }
+
+    if (n_false_positives > n_keys / 10)
+    {
+        seqan3::debug_stream << "BLOOM FILTER ACCEPTED " << n_false_positives << " OF " << n_keys << " ABSENT KEYS\n";
+        exit(1);
+    }
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        auto bloom_kmer = kmer::make_kmer_index<10, 12>(text, 1, {.filter = kmer::MEMBERSHIP_FILTER::BLOOM});
+
+        auto index_file = temporary_file("test_index.bin");
+        bloom_kmer.save(index_file.path);
+        auto loaded_kmer = decltype(bloom_kmer)::load(index_file.path);
+
+        // odd sized queries are random and mostly absent, so the filter rejects them
+        std::vector<std::vector<alphabet_t>> queries;
+        for (size_t query_size = 10; query_size < 40; query_size++)
+            queries.push_back(sample_query(input, text, query_size));
+
+        auto batch_results = bloom_kmer.search_batch(queries);
+
+        for (size_t j = 0; j < queries.size(); ++j)
+        {
+            auto expected = naive_search(text, queries[j]);
+
+            check_equal(expected, bloom_kmer.search(queries[j]).to_vector(), "bloom search");
+            check_equal(expected, loaded_kmer.search(queries[j]).to_vector(), "loaded bloom search");
+            check_equal(expected, batch_results[j].to_vector(), "bloom search_batch");
+            check_count(expected, bloom_kmer.count(queries[j]), "bloom count");
+        }
+    }
+}
+
+// positions with at most max_errors substitutions, in a text and in a collection built from chunks
+void run_approximate_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        auto approximate_kmer = kmer::make_kmer_index<5, 6, 7>(text, 1, {.approximate = kmer::APPROXIMATE_SEARCH::ENABLED});
+
+        // parts of the pigeonhole split are only searched with a spaced k if they cover its span
+        auto spaced_kmer = kmer::make_kmer_index<5, 6, 7>(text, 1, {.approximate = kmer::APPROXIMATE_SEARCH::ENABLED,
+                                                                    .shapes = {0, spaced_shape(6), spaced_shape(7)}});
+
+        // the same text split into two sequences, no hit may span both
+        std::vector<std::vector<alphabet_t>> collection = {{text.begin(), text.begin() + text.size() / 2},
+                                                           {text.begin() + text.size() / 2, text.end()}};
+
+        auto builder = kmer::kmer_index_builder<alphabet_t, uint32_t, 5, 6, 7>();
+        for (auto& sequence : collection)
+        {
+            builder.start_sequence();
+            builder.append(sequence);
+        }
+
+        auto collection_kmer = builder.finalize(1, {.approximate = kmer::APPROXIMATE_SEARCH::ENABLED});
+
+        for (size_t query_size = 6; query_size < 32; query_size++)
+        {
+            auto query = sample_query(input, text, query_size);
+
+            // substitute some characters so that the query only occurs with errors
+            for (size_t j = 0; j < query_size / 10; ++j)
+            {
+                auto& c = query[(j * 7 + 3) % query_size];
+                c.assign_rank((seqan3::to_rank(c) + 1) % seqan3::alphabet_size<alphabet_t>);
+            }
+
+            for (size_t max_errors = 0; max_errors <= 3 and max_errors < query_size; ++max_errors)
+            {
+                auto expected = naive_search_approximate(text, query, max_errors);
+                check_equal(expected, approximate_kmer.search_approximate(query, max_errors).to_vector(),
+                            "approximate search, max_errors = " + std::to_string(max_errors));
+                check_equal(expected, spaced_kmer.search_approximate(query, max_errors).to_vector(),
+                            "spaced approximate search, max_errors = " + std::to_string(max_errors));
+
+                std::vector<unsigned int> expected_collection;
+                size_t start = 0;
+                for (auto& sequence : collection)
+                {
+                    for (unsigned int pos : naive_search_approximate(sequence, query, max_errors))
+                        expected_collection.push_back(start + pos);
+
+                    start += sequence.size() + 1;
+                }
+
+                check_equal(expected_collection, collection_kmer.search_approximate(query, max_errors).to_vector(),
+                            "approximate collection search, max_errors = " + std::to_string(max_errors));
+            }
+        }
+    }
+
+    // the text is only kept if approximate search is enabled
+    auto input = input_generator<alphabet_t>(seed++);
+    auto text = input.generate_sequence(1000);
+    auto exact_kmer = kmer::make_kmer_index<5>(text, 1);
+    auto query = input.generate_sequence(20);
+
+    bool thrown = false;
+    try { exact_kmer.search_approximate(query, 1); }
+    catch (std::invalid_argument&) { thrown = true; }
+
+    if (not thrown)
+    {
+        seqan3::debug_stream << "NO EXCEPTION FOR approximate search without APPROXIMATE_SEARCH::ENABLED\n";
+        exit(1);
+    }
+}
+
+// bit searches and word level operations of compressed_bitset compared with a std::vector<bool>
+void run_bitset_test()
+{
+    std::mt19937 engine(seed++);
+
+    for (size_t n_bits : {0, 1, 63, 64, 65, 200, 1000})
+    {
+        // sparse and dense bitsets
+        for (size_t one_in : {1, 2, 50, 1000})
+        {
+            auto bitset = kmer::detail::compressed_bitset(n_bits, false);
+            std::vector<bool> expected(n_bits, false);
+
+            for (size_t i = 0; i < n_bits; ++i)
+            {
+                if (engine() % one_in == 0)
+                {
+                    bitset.set_1(i);
+                    expected[i] = true;
+                }
+            }
+
+            // i beyond the end is valid for both
+            for (size_t i = 0; i <= n_bits + 1; ++i)
+            {
+                size_t next = i;
+                while (next < n_bits and not expected[next])
+                    ++next;
+
+                size_t previous = std::min(i, n_bits > 0 ? n_bits - 1 : 0);
+                while (previous < n_bits and not expected[previous])
+                    previous = previous > 0 ? previous - 1 : n_bits;
+
+                if (bitset.next_1(i) != std::min(next, n_bits) or bitset.previous_1(i) != previous)
+                {
+                    seqan3::debug_stream << "NOT EQUAL FOR next_1 / previous_1 at " << i << " of " << n_bits
+                                         << " bits\nseed = " << seed << "\n";
+                    exit(1);
+                }
+            }
+
+            // word level operations with a second random bitset
+            auto other = kmer::detail::compressed_bitset(n_bits, false);
+            std::vector<bool> expected_other(n_bits, false);
+
+            for (size_t i = 0; i < n_bits; ++i)
+            {
+                if (engine() % 2 == 0)
+                {
+                    other.set_1(i);
+                    expected_other[i] = true;
+                }
+            }
+
+            size_t first = n_bits > 0 ? engine() % n_bits : 0;
+            size_t last = first + (n_bits > first ? engine() % (n_bits - first + 1) : 0);
+            bool zero_or_one = engine() % 2 == 0;
+
+            auto check_bits = [&](const std::string& name)
+            {
+                size_t n_ones = std::count(expected.begin(), expected.end(), true);
+
+                bool equal = bitset.to_vector() == expected and bitset.count_bits_equal_to(true) == n_ones
+                             and bitset.count_bits_equal_to(false) == n_bits - n_ones;
+
+                for (size_t i = 0; i <= n_bits; ++i)
+                    equal = equal and bitset.rank_1(i) == size_t(std::count(expected.begin(), expected.begin() + i, true));
+
+                for (size_t n = 0, i = 0; i <= n_bits; ++i)
+                {
+                    if (i < n_bits and not expected[i])
+                        continue;
+
+                    // the nth 1 is at i, or there is no nth 1
+                    equal = equal and bitset.select_1(n++) == i;
+                }
+
+                if (not equal)
+                {
+                    seqan3::debug_stream << "NOT EQUAL FOR bitset " << name << " of " << n_bits << " bits\nseed = " << seed << "\n";
+                    exit(1);
+                }
+            };
+
+            check_bits("popcount");
+
+            bitset.set_range(first, last, zero_or_one);
+            for (size_t i = first; i < last; ++i)
+                expected[i] = zero_or_one;
+
+            check_bits("set_range");
+
+            auto copy = bitset;
+            auto expected_copy = expected;
+
+            bitset &= other;
+            for (size_t i = 0; i < n_bits; ++i)
+                expected[i] = expected[i] and expected_other[i];
+
+            check_bits("operator&=");
+
+            bitset = copy;
+            expected = expected_copy;
+
+            bitset |= other;
+            for (size_t i = 0; i < n_bits; ++i)
+                expected[i] = expected[i] or expected_other[i];
+
+            check_bits("operator|=");
+
+            bitset = copy;
+            expected = expected_copy;
+
+            bitset.and_not(other);
+            for (size_t i = 0; i < n_bits; ++i)
+                expected[i] = expected[i] and not expected_other[i];
+
+            check_bits("and_not");
+        }
+    }
+}
+
+// sorted runs merged by to_vector compared with sorting their concatenation
+void run_merge_test()
+{
+    std::mt19937 engine(seed++);
+
+    // a single run, few long runs that are merged and many short runs that are sorted
+    for (size_t n_runs : {1, 2, 3, 7, 64, 1000})
+    {
+        for (size_t run_size : {0, 1, 10, 300, 2000})
+        {
+            std::vector<std::vector<unsigned int>> runs(n_runs);
+            std::vector<unsigned int> expected;
+
+            for (auto& run : runs)
+            {
+                // runs of varying size with duplicates between them
+                size_t size = run_size > 0 ? engine() % (2 * run_size) : 0;
+                for (size_t i = 0; i < size; ++i)
+                    run.push_back(engine() % (10 * run_size * n_runs + 1));
+
+                std::sort(run.begin(), run.end());
+                expected.insert(expected.end(), run.begin(), run.end());
+            }
+
+            std::sort(expected.begin(), expected.end());
+
+            std::vector<std::span<const unsigned int>> views(runs.begin(), runs.end());
+            auto result = kmer::detail::kmer_index_result<unsigned int>(views);
+
+            check_equal(expected, result.to_vector(), "merge of " + std::to_string(n_runs) + " runs");
+            check_count(expected, result.size(), "size of " + std::to_string(n_runs) + " runs");
+        }
+    }
+}
+
+// iterating a result forwards and backwards visits the same positions as to_vector
+void run_iterator_test()
+{
+    using alphabet_t = seqan3::dna4;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        auto input = input_generator<alphabet_t>(seed++);
+        auto text = input.generate_sequence(text_size / 10);
+
+        // queries shorter than k return many spans, the others a single span
+        auto plain_kmer = kmer::make_kmer_index<5, 10>(text, 1);
+        auto encoded_kmer = kmer::make_kmer_index<5, 10>(text, 1, {.encoding = kmer::POSITION_ENCODING::ELIAS_FANO});
+
+        // queries of at least 13 are looked up by the minimizers of k = 10, their result rejects candidates by bitmask
+        auto minimizer_kmer = kmer::make_kmer_index<5, 10>(text, 1, {.minimizer_window = 4});
+
+        for (size_t query_size = 2; query_size < 26; query_size++)
+        {
+            auto query = sample_query(input, text, query_size);
+            auto expected = naive_search(text, query);
+
+            for (auto result : {plain_kmer.search(query), encoded_kmer.search(query), minimizer_kmer.search(query)})
+            {
+                // the iterator visits positions in the order they are stored, which need not be sorted
+                std::vector<unsigned int> forward(result.begin(), result.end());
+
+                std::vector<unsigned int> backward;
+                for (auto it = result.end(); it != result.begin();)
+                    backward.push_back(*--it);
+
+                std::vector<unsigned int> reversed;
+                for (auto pos : result | std::views::reverse)
+                    reversed.push_back(pos);
+
+                std::reverse(backward.begin(), backward.end());
+                std::reverse(reversed.begin(), reversed.end());
+
+                check_equal(forward, backward, "backward iteration");
+                check_equal(forward, reversed, "std::views::reverse");
+                check_count(forward, result.size(), "size of iterated result");
+
+                std::sort(forward.begin(), forward.end());
+                check_equal(expected, forward, "forward iteration");
+            }
+        }
+    }
+}
+
 // TODO: rewrite in google test
 int main()
 {
     seqan3::debug_stream << "starting test...\n";
 
+    run_elias_fano_test();
+    run_corrupted_file_test();
+    run_canonical_test();
+    run_wide_hash_test<40>();
+    run_wide_hash_test<70>();
+    run_collection_test();
+    run_minimizer_test();
+    run_builder_test();
+    run_batch_test();
+    run_bloom_filter_test();
+    run_approximate_test();
+    run_bitset_test();
+    run_merge_test();
+    run_iterator_test();
+    run_encoding_test<alphabet_2, k_2>();
+    run_encoding_test<alphabet_2, k_1>();
+    run_encoding_test<alphabet_2, k_0>();
+
     run_test<alphabet_2, k_2>();
     run_test<alphabet_2, k_1>();
     run_test<alphabet_2, k_0>();
@@ -12,6 +12,7 @@
 #include <queue>
 #include <functional>
 #include <map>
+#include <vector>
 #include <iostream>
 
 namespace kmer::detail
@@ -108,6 +109,42 @@ struct thread_pool
         }
 };
 
+// run f(0), ..., f(n-1) as tasks of pool and wait for all of them to finish, the first exception thrown by
+// any f(i) is rethrown once every task is done, as running tasks still reference f and the callers locals
+// should not be called from inside a task of the same pool with n > 1, as the waiting task would occupy a worker
+// a single f(0) is run by the calling thread, which is what tasks of the pool may use it for
+template<typename function_t>
+void parallel_for(thread_pool& pool, size_t n, function_t&& f)
+{
+    if (n == 1)
+    {
+        f(0);
+        return;
+    }
+
+    std::vector<std::future<void>> futures;
+    futures.reserve(n);
+
+    try
+    {
+        for (size_t i = 0; i < n; ++i)
+            futures.emplace_back(pool.execute([&f, i]() { f(i); }));
+    }
+    catch (...)
+    {
+        for (auto& future : futures)
+            future.wait();
+
+        throw;
+    }
+
+    for (auto& future : futures)
+        future.wait();
+
+    for (auto& future : futures)
+        future.get();
+}
+
 } // end of namespace kmer::detail
 
 // references used: